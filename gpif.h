@@ -4,20 +4,66 @@
 ///////////////////////////////////////////////////////////////////////
 //
 
-union u_opcode {
+// Fields of the wave table bytes, decoded and encoded by shift and
+// mask on the byte itself, so the bit positions are the EZ-USB TRM's
+// and no union member is read after another was written. bits() and
+// its kin return a view of the byte whose fields convert to unsigned
+// and assign from unsigned, changing only their own bits of the byte.
+
+template <unsigned shift,unsigned width>
+struct s_field {
+	static constexpr uint8_t
+	mask() { return uint8_t(((1u << width) - 1) << shift); }
+
+	static constexpr unsigned
+	decode(uint8_t byte) { return (byte & mask()) >> shift; }
+
+	static constexpr uint8_t
+	encode(uint8_t byte,unsigned value) { return uint8_t((byte & ~mask()) | ((value << shift) & mask())); }
+};
+
+// One field of a referenced byte, read-only when Byte is const
+template <typename Byte,unsigned shift,unsigned width>
+class s_field_ref {
+	Byte&			byte;
+
+public:
+	explicit s_field_ref(Byte& b) : byte(b) {}
+
+	operator unsigned() const { return s_field<shift,width>::decode(byte); }
+
+	s_field_ref&
+	operator=(unsigned value) {
+		byte = s_field<shift,width>::encode(byte,value);
+		return *this;
+	}
+
+	s_field_ref&
+	operator=(const s_field_ref& other) { return *this = unsigned(other); }
+};
+
+struct u_opcode {
 	uint8_t			byte;
-	struct s_opcode {
-		uint8_t	dp : 1;		// 1 == DP
-		uint8_t	data : 1;	// 1 == Drive FIFO / Sample
-		uint8_t	next : 1;	// 1 == move next to FIFO, or use UDMACRCH:L
-		uint8_t	incad : 1;	// 1 == increment GPIFADR
-		uint8_t	gint : 1;	// 1 == generate a GPIFWF
-		uint8_t	sgl : 1;	// 1 == use SGLDATH:L / UDMACRCH:L
-		uint8_t	reserved : 2;	// Ignored
-	}			bits;
+
+	template <typename Byte>
+	struct s_bits {
+		s_field_ref<Byte,0,1> dp;	// 1 == DP
+		s_field_ref<Byte,1,1> data;	// 1 == Drive FIFO / Sample
+		s_field_ref<Byte,2,1> next;	// 1 == move next to FIFO, or use UDMACRCH:L
+		s_field_ref<Byte,3,1> incad;	// 1 == increment GPIFADR
+		s_field_ref<Byte,4,1> gint;	// 1 == generate a GPIFWF
+		s_field_ref<Byte,5,1> sgl;	// 1 == use SGLDATH:L / UDMACRCH:L
+		s_field_ref<Byte,6,2> reserved;	// Ignored
+
+		explicit s_bits(Byte& b)
+		: dp(b), data(b), next(b), incad(b), gint(b), sgl(b), reserved(b) {}
+	};
+
+	s_bits<uint8_t> bits() { return s_bits<uint8_t>(byte); }
+	s_bits<const uint8_t> bits() const { return s_bits<const uint8_t>(byte); }
 };
 
-union u_logfunc {
+struct u_logfunc {
 	enum class e_logfunc {
 		a_and_b = 0,
 		a_or_b = 1,
@@ -25,44 +71,75 @@ union u_logfunc {
 		na_and_b = 3
 	};
 	uint8_t			byte;
-	struct s_logfunc {
-		uint8_t	termb : 3;	// TERM B
-		uint8_t	terma : 3;	// TERM A
-		uint8_t	lfunc : 2;	// e_log_func
-	}			bits;
+
+	template <typename Byte>
+	struct s_bits {
+		s_field_ref<Byte,0,3> termb;	// TERM B
+		s_field_ref<Byte,3,3> terma;	// TERM A
+		s_field_ref<Byte,6,2> lfunc;	// e_log_func
+
+		explicit s_bits(Byte& b) : termb(b), terma(b), lfunc(b) {}
+	};
+
+	s_bits<uint8_t> bits() { return s_bits<uint8_t>(byte); }
+	s_bits<const uint8_t> bits() const { return s_bits<const uint8_t>(byte); }
 };
 
-union u_branch {
+struct u_branch {
 	uint8_t			byte;
-	struct s_branch {
-		uint8_t	branchon0 : 3;
-		uint8_t	branchon1 : 3;
-		uint8_t	reserved  : 1;
-		uint8_t	reexecute : 1;
-	}			bits;
+
+	template <typename Byte>
+	struct s_bits {
+		s_field_ref<Byte,0,3> branchon0;
+		s_field_ref<Byte,3,3> branchon1;
+		s_field_ref<Byte,6,1> reserved;
+		s_field_ref<Byte,7,1> reexecute;
+
+		explicit s_bits(Byte& b) : branchon0(b), branchon1(b), reserved(b), reexecute(b) {}
+	};
+
+	s_bits<uint8_t> bits() { return s_bits<uint8_t>(byte); }
+	s_bits<const uint8_t> bits() const { return s_bits<const uint8_t>(byte); }
 };
 
-union u_output {
+struct u_output {
 	uint8_t			byte;
-	struct s_output1 {
-		uint8_t	ctl0 : 1;
-		uint8_t	ctl1 : 1;
-		uint8_t	ctl2 : 1;
-		uint8_t	ctl3 : 1;
-		uint8_t	oes0 : 1;
-		uint8_t	oes1 : 1;
-		uint8_t	oes2 : 1;
-		uint8_t	oes3 : 1;
-	}			bits1;
-	struct s_output0 {
-		uint8_t	ctl0 : 1;
-		uint8_t	ctl1 : 1;
-		uint8_t	ctl2 : 1;
-		uint8_t	ctl3 : 1;
-		uint8_t	ctl4 : 1;
-		uint8_t	ctl5 : 1;
-		uint8_t	reserved : 2;
-	}			bits0;
+
+	// TRICTL == 1: CTL0..3 and their output enables
+	template <typename Byte>
+	struct s_bits1 {
+		s_field_ref<Byte,0,1> ctl0;
+		s_field_ref<Byte,1,1> ctl1;
+		s_field_ref<Byte,2,1> ctl2;
+		s_field_ref<Byte,3,1> ctl3;
+		s_field_ref<Byte,4,1> oes0;
+		s_field_ref<Byte,5,1> oes1;
+		s_field_ref<Byte,6,1> oes2;
+		s_field_ref<Byte,7,1> oes3;
+
+		explicit s_bits1(Byte& b)
+		: ctl0(b), ctl1(b), ctl2(b), ctl3(b), oes0(b), oes1(b), oes2(b), oes3(b) {}
+	};
+
+	// TRICTL == 0: CTL0..5
+	template <typename Byte>
+	struct s_bits0 {
+		s_field_ref<Byte,0,1> ctl0;
+		s_field_ref<Byte,1,1> ctl1;
+		s_field_ref<Byte,2,1> ctl2;
+		s_field_ref<Byte,3,1> ctl3;
+		s_field_ref<Byte,4,1> ctl4;
+		s_field_ref<Byte,5,1> ctl5;
+		s_field_ref<Byte,6,2> reserved;
+
+		explicit s_bits0(Byte& b)
+		: ctl0(b), ctl1(b), ctl2(b), ctl3(b), ctl4(b), ctl5(b), reserved(b) {}
+	};
+
+	s_bits1<uint8_t> bits1() { return s_bits1<uint8_t>(byte); }
+	s_bits1<const uint8_t> bits1() const { return s_bits1<const uint8_t>(byte); }
+	s_bits0<uint8_t> bits0() { return s_bits0<uint8_t>(byte); }
+	s_bits0<const uint8_t> bits0() const { return s_bits0<const uint8_t>(byte); }
 };
 #if 0
 struct s_instr {
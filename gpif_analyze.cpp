@@ -0,0 +1,878 @@
+//////////////////////////////////////////////////////////////////////
+// gpif_analyze.cpp -- Timing analysis of compiled GPIF wave tables
+///////////////////////////////////////////////////////////////////////
+//
+// Reads a wave table (gpif_compiler output or gpif.c) and reports
+// timing figures derived from the cycle model in gpif_sim.h:
+//
+//    $ ./gpif_analyze [--ifclk=hz] [--inputs=n] [--addr=n] [--gint-max=n]
+//		[--idlectl=n] [--trictl=0|1] [--cpuclk=hz] [--tc=n]
+//		mode... file.inc[:name]
+//
+// --rdy	For each DP state: IFCLK cycles from the cycle sampling
+//		its condition true to the next DATA strobe and the next
+//		CTL/OE edge (min..max over all later inputs) and how long
+//		a peripheral must hold RDY asserted until it is sampled.
+//
+// --sgl	Single transaction waveforms: cycles from trigger to idle
+//		and transactions/s, the states using SGLDAT/UDMACRC and
+//		the GPIFADR sequence produced by INCAD (+), starting at
+//		--addr=n, for the input vector --inputs=n (default 0xFF,
+//		bit n is term n: RDY0..RDY5/TC, FIFO, INTRDY).
+//
+// --events	Steady state rates of the DATA strobes, NEXT advances,
+//		INCAD address increments and GINT interrupts for the
+//		input vector --inputs=n, with a warning if the GINT rate
+//		exceeds --gint-max=n per second (default 100000, about
+//		what an 8051 INT4 handler at 48 MHz can service).
+//
+// --idle	Cycles from the trigger (first cycle of state 0) to the
+//		first DATA strobe and CTL edge, from the last strobe to
+//		idle and the dead time of a restart for --inputs=n, and
+//		the CTL/OE levels at the trigger and on entering idle
+//		from each state that goes idle, with the idle levels
+//		GPIFIDLECTL --idlectl=n (default 0xFF) and --trictl=0|1
+//		(default 1). A line leaving its level only while idle is
+//		reported as a glitch.
+//
+// --cpu=fifo|retrigger|interrupt
+//		8051 cost per transaction for a firmware servicing
+//		pattern, in instruction cycles (4 clocks at --cpuclk=hz,
+//		default 48 MHz) from a model sequence of each pattern:
+//		fifo: GPIFTCB armed for --tc=n transactions (default
+//		512), the GPIF restarts by itself (one idle cycle), the
+//		endpoint commits automatically; retrigger: a polling loop
+//		triggering each transaction (EPxGPIFTRIG, or SGLDAT if
+//		the table has SGL data states); interrupt: the GPIFDONE
+//		handler triggers the next one. GINT states add a GPIFWF
+//		handler each. With the transaction cycles for --inputs=n
+//		it tells whether the transfer is GPIF- or CPU-bound.
+//
+// "..inputs" means the maximum depends on later inputs (a wait
+// loop or the idle state on the way).
+//
+// The IFCLK frequency is taken from ifconfig_n for the internal
+// clock, --ifclk=hz sets it for an external one.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <map>
+#include <deque>
+#include <functional>
+#include <algorithm>
+#include "gpif.h"
+#include "gpif_sim.h"
+#include "gpif_table.h"
+
+
+static const char *termnames[8] = {
+	"RDY0", "RDY1", "RDY2", "RDY3", "RDY4", "RDY5/TC", "FIFO", "INTRDY"
+};
+
+static const char *funcnames[4] = {
+	"AND", "OR", "XOR", "/AND"
+};
+
+static const unsigned unbounded = ~0u;
+
+static double ifclk = 0;		// Hz, 0: unknown
+static unsigned inputs = 0xFF;		// --inputs
+static unsigned address = 0;		// --addr, GPIFADR[8:0]
+static double gint_max = 100000;	// --gint-max, GINT/s
+static unsigned idlectl = 0xFF;		// --idlectl, GPIFIDLECTL
+static bool trictl = true;		// --trictl
+static double cpuclk = 48e6;		// --cpuclk, 8051 clock
+static unsigned long tc = 512;		// --tc, transactions per trigger
+
+struct s_analysis {
+	s_wavetable		table;
+	s_state			states[8];
+};
+
+//////////////////////////////////////////////////////////////////////
+// Cycles until a cycle satisfying pred, over all input sequences
+//////////////////////////////////////////////////////////////////////
+
+struct s_node {
+	s_machine		m;
+	uint8_t			prevout;	// Output of the previous cycle
+};
+
+typedef std::function<bool(const s_node&)> Predicate;
+
+struct s_reach {
+	unsigned		min;		// unbounded: never
+	unsigned		max;		// unbounded: inputs can stall it
+};
+
+static uint32_t
+node_key(const s_node& n) {
+	return n.m.state | (n.m.remain & 0x1FF) << 3 | uint32_t(n.m.fresh) << 12 | uint32_t(n.prevout) << 13;
+}
+
+static void
+successors(const s_node& n,const s_state states[8],std::vector<s_node>& next) {
+	const unsigned terms = machine_terms(n.m,states);
+	unsigned inputs = 0;
+
+	next.clear();
+	do	{
+		s_node s = { n.m, n.m.state < 7 ? states[n.m.state].output.byte : n.prevout };
+		machine_step(s.m,states,inputs);
+		next.push_back(s);
+		inputs = (inputs - terms) & terms;
+	} while ( inputs );
+}
+
+// Longest path to pred, unbounded on a loop or idle without pred
+static unsigned
+longest(const s_node& n,const s_state states[8],const Predicate& pred,
+  std::map<uint32_t,unsigned>& memo,std::map<uint32_t,bool>& active) {
+	const uint32_t key = node_key(n);
+
+	if ( pred(n) )
+		return 0;
+	if ( n.m.state >= 7 || active[key] )
+		return unbounded;
+	auto it = memo.find(key);
+	if ( it != memo.end() )
+		return it->second;
+
+	std::vector<s_node> next;
+	unsigned worst = 0;
+
+	active[key] = true;
+	successors(n,states,next);
+	for ( auto& s : next ) {
+		unsigned l = longest(s,states,pred,memo,active);
+		if ( l == unbounded ) {
+			worst = unbounded;
+			break;
+		}
+		if ( l + 1 > worst )
+			worst = l + 1;
+	}
+	active[key] = false;
+	memo[key] = worst;
+	return worst;
+}
+
+static s_reach
+reach(const s_node& start,const s_state states[8],const Predicate& pred) {
+	s_reach r = { unbounded, unbounded };
+	std::map<uint32_t,unsigned> dist;
+	std::deque<s_node> queue;
+	std::vector<s_node> next;
+
+	dist[node_key(start)] = 0;
+	queue.push_back(start);
+	while ( !queue.empty() ) {
+		s_node n = queue.front();
+		queue.pop_front();
+		unsigned d = dist[node_key(n)];
+
+		if ( pred(n) ) {
+			r.min = d;
+			break;
+		}
+		if ( n.m.state >= 7 )
+			continue;
+		successors(n,states,next);
+		for ( auto& s : next ) {
+			if ( dist.find(node_key(s)) == dist.end() ) {
+				dist[node_key(s)] = d + 1;
+				queue.push_back(s);
+			}
+		}
+	}
+	if ( r.min != unbounded ) {
+		std::map<uint32_t,unsigned> memo;
+		std::map<uint32_t,bool> active;
+		r.max = longest(start,states,pred,memo,active);
+	}
+	return r;
+}
+
+static std::string
+cycles(unsigned c) {
+	std::stringstream ss;
+
+	if ( c == unbounded )
+		return "-";
+	ss << c;
+	if ( ifclk > 0 )
+		ss << " (" << std::fixed << std::setprecision(1) << c * 1e9 / ifclk << "ns)";
+	return ss.str();
+}
+
+static std::string
+range(const s_reach& r) {
+	if ( r.min == unbounded )
+		return "never";
+	if ( r.max == unbounded )
+		return cycles(r.min) + "..inputs";
+	if ( r.min == r.max )
+		return cycles(r.min);
+	return cycles(r.min) + ".." + cycles(r.max);
+}
+
+//////////////////////////////////////////////////////////////////////
+// --rdy: reaction latency of the DP states
+//////////////////////////////////////////////////////////////////////
+
+static void
+analyze_rdy(const s_analysis& an) {
+	const s_state *states = an.states;
+	bool any = false;
+
+	std::cout << ";\n; RDY reaction latency: cycles after the cycle sampling the condition true\n"
+		<< "; hold: how long RDY must stay asserted to be sampled by the DP\n;\n";
+	std::cout << std::left << std::setw(7) << "state" << std::setw(24) << "condition"
+		<< std::setw(12) << "then/else" << std::setw(24) << "hold"
+		<< std::setw(30) << "to DATA" << "to CTL edge\n";
+
+	for ( unsigned sx=0; sx<7; ++sx ) {
+		const s_state& dp = states[sx];
+
+		if ( !dp.opcode.bits().dp )
+			continue;
+		any = true;
+
+		// State after sampling the condition true
+		s_node taken = { { sx, 1, false }, dp.output.byte };
+		{
+			unsigned inputs = 0;
+			for ( ; inputs < 256 && !dp_condition(dp,inputs); ++inputs )
+				;
+			machine_step(taken.m,states,inputs);
+		}
+
+		const s_state *st = states;
+		Predicate strobe = [st](const s_node& n) {
+			return (machine_actions(n.m,st) & 0x02) != 0;
+		};
+		Predicate edge = [st](const s_node& n) {
+			return n.m.state < 7 && st[n.m.state].output.byte != n.prevout;
+		};
+
+		// Hold: interval between two samples of this DP
+		s_reach hold = { 1, 1 };
+		if ( dp.branch.bits().branchon0 != sx ) {		// Else polls every cycle
+			Predicate again = [sx](const s_node& n) {
+				return n.m.state == sx;
+			};
+			s_node after = { { sx, 1, false }, dp.output.byte };
+			unsigned inputs = 0;
+			for ( ; inputs < 256 && dp_condition(dp,inputs); ++inputs )
+				;
+			machine_step(after.m,states,inputs);
+			hold = reach(after,states,again);
+			hold.min += hold.min != unbounded;
+			hold.max += hold.max != unbounded;
+		}
+
+		std::stringstream cond, targets;
+		cond << termnames[dp.logfunc.bits().terma] << ' ' << funcnames[dp.logfunc.bits().lfunc]
+			<< ' ' << termnames[dp.logfunc.bits().termb];
+		targets << '$' << unsigned(dp.branch.bits().branchon1) << " $" << unsigned(dp.branch.bits().branchon0);
+
+		s_reach rs = reach(taken,states,strobe);
+		s_reach re = reach(taken,states,edge);
+		rs.min += rs.min != unbounded;	// Count from the sampling cycle
+		re.min += re.min != unbounded;
+		rs.max += rs.max != unbounded;
+		re.max += re.max != unbounded;
+
+		std::cout << '$' << std::setw(6) << sx << std::setw(24) << cond.str()
+			<< std::setw(12) << targets.str()
+			<< std::setw(24) << (hold.min == unbounded ? std::string("once per trigger") : range(hold))
+			<< std::setw(30) << range(rs) << range(re) << '\n';
+	}
+	if ( !any )
+		std::cout << "; no DP states\n";
+	std::cout << std::right;
+}
+
+static std::string
+rate(double r) {
+	std::stringstream ss;
+
+	ss << std::fixed << std::setprecision(1);
+	if ( r >= 1e6 )
+		ss << r / 1e6 << 'M';
+	else if ( r >= 1e3 )
+		ss << r / 1e3 << 'k';
+	else	ss << r;
+	return ss.str();
+}
+
+static std::string
+opcode_chars(uint8_t byte) {
+	u_opcode opcode;
+	std::string s;
+
+	opcode.byte = byte;
+	if ( opcode.bits().sgl )
+		s += 'S';
+	if ( opcode.bits().incad )
+		s += '+';
+	if ( opcode.bits().gint )
+		s += 'G';
+	if ( opcode.bits().data )
+		s += 'D';
+	if ( opcode.bits().next )
+		s += 'N';
+	return s;
+}
+
+//////////////////////////////////////////////////////////////////////
+// --sgl: single transaction cost and address sequence
+//////////////////////////////////////////////////////////////////////
+
+static void
+analyze_sgl(const s_analysis& an) {
+	const s_state *states = an.states;
+	s_node start = { { 0, 0, false }, 0 };
+	std::string sgl;
+
+	machine_reset(start.m,states);
+	Predicate idle = [](const s_node& n) {
+		return n.m.state >= 7;
+	};
+	s_reach r = reach(start,states,idle);
+
+	std::cout << ";\n; Single transaction: cycles from trigger to idle " << range(r) << '\n';
+	if ( ifclk > 0 && r.min != unbounded ) {
+		std::cout << "; transactions/s: " << rate(ifclk / r.min);
+		if ( r.max != unbounded && r.max != r.min )
+			std::cout << " best, " << rate(ifclk / r.max) << " worst";
+		std::cout << '\n';
+	}
+	if ( r.min == unbounded )
+		std::cout << "; never goes idle, not a single transaction waveform\n";
+
+	for ( unsigned sx=0; sx<7; ++sx ) {
+		if ( states[sx].opcode.bits().sgl && (states[sx].opcode.bits().data || states[sx].opcode.bits().next) ) {
+			sgl += " $" + std::to_string(sx);
+			sgl += states[sx].opcode.bits().data ? "(SGLDAT)" : "(UDMACRC)";
+		}
+	}
+	std::cout << "; SGL data states:" << (sgl.empty() ? " none" : sgl) << '\n';
+
+	// Trace of state entries and GPIFADR
+	s_machine m;
+	unsigned adr = address & 0x1FF;
+	unsigned cycle = 0, entries = 0;
+
+	std::cout << ";\n; GPIFADR sequence, inputs 0x" << std::hex << std::setw(2) << std::setfill('0')
+		<< inputs << std::dec << std::setfill(' ') << ":\n;\n"
+		<< std::left << std::setw(8) << "cycle" << std::setw(7) << "state"
+		<< std::setw(10) << "GPIFADR" << "actions\n";
+
+	machine_reset(m,states);
+	while ( m.state < 7 && entries < 64 && cycle < 0x10000 ) {
+		const uint8_t actions = machine_actions(m,states);
+
+		if ( m.fresh ) {
+			std::stringstream a;
+			a << "0x" << std::hex << std::uppercase << std::setw(3) << std::setfill('0') << adr;
+			std::cout << std::setw(8) << cycle << '$' << std::setw(6) << m.state
+				<< std::setw(10) << a.str() << opcode_chars(actions) << '\n';
+			++entries;
+		}
+		if ( actions & 0x08 )		// INCAD
+			adr = (adr + 1) & 0x1FF;
+		machine_step(m,states,inputs);
+		++cycle;
+	}
+	if ( m.state >= 7 )
+		std::cout << std::setw(8) << cycle << std::setw(7) << "$7"
+			<< "idle, GPIFADR 0x" << std::hex << std::uppercase << std::right << std::setw(3) << std::setfill('0') << adr
+			<< std::dec << std::nouppercase << std::setfill(' ') << '\n';
+	else	std::cout << "; not idle after " << cycle << " cycles with these inputs\n";
+	std::cout << std::right;
+}
+
+//////////////////////////////////////////////////////////////////////
+// --events: opcode side effects per second in steady state
+//////////////////////////////////////////////////////////////////////
+
+struct s_events {
+	unsigned		cycles;		// Loop period, or to idle
+	bool			idle;		// Ends in idle, no steady state
+	unsigned		data, next, incad, gint;
+};
+
+// Run with constant inputs until the machine state repeats
+static bool
+steady_state(const s_state states[8],unsigned inputs,s_events& ev) {
+	std::map<uint32_t,unsigned> seen;	// Machine state -> cycle
+	std::vector<uint8_t> actions;
+	s_machine m;
+
+	machine_reset(m,states);
+	for ( unsigned cycle=0; cycle < 0x20000; ++cycle ) {
+		const uint32_t key = m.state | m.remain << 3 | uint32_t(m.fresh) << 12;
+		unsigned start = 0;
+
+		if ( m.state >= 7 ) {
+			ev.idle = true;
+		} else	{
+			auto it = seen.find(key);
+			if ( it == seen.end() ) {
+				seen[key] = cycle;
+				actions.push_back(machine_actions(m,states));
+				machine_step(m,states,inputs);
+				continue;
+			}
+			start = it->second;
+			ev.idle = false;
+		}
+		ev.cycles = cycle - start;
+		ev.data = ev.next = ev.incad = ev.gint = 0;
+		for ( unsigned cx=start; cx<cycle; ++cx ) {
+			u_opcode op;
+			op.byte = actions[cx];
+			ev.data += op.bits().data;
+			ev.next += op.bits().next;
+			ev.incad += op.bits().incad;
+			ev.gint += op.bits().gint;
+		}
+		return true;
+	}
+	return false;
+}
+
+static void
+analyze_events(const s_analysis& an) {
+	s_events ev;
+
+	if ( !steady_state(an.states,inputs,ev) ) {
+		std::cout << ";\n; no steady state found\n";
+		return;
+	}
+	std::cout << ";\n; Events, inputs 0x" << std::hex << std::setw(2) << std::setfill('0') << inputs
+		<< std::dec << std::setfill(' ') << ", "
+		<< (ev.idle ? "single pass to idle " : "steady state loop ") << cycles(ev.cycles) << ":\n;\n"
+		<< std::left << std::setw(10) << "event" << std::setw(12) << (ev.idle ? "per pass" : "per loop")
+		<< (ev.idle ? "per second (retriggered at once)" : "per second") << '\n';
+
+	const struct {
+		const char	*name;
+		unsigned	count;
+	} rows[] = {
+		{ "DATA",	ev.data },
+		{ "NEXT",	ev.next },
+		{ "INCAD",	ev.incad },
+		{ "GINT",	ev.gint },
+	};
+	for ( auto& row : rows ) {
+		std::cout << std::setw(10) << row.name << std::setw(12) << row.count;
+		if ( ifclk > 0 )
+			std::cout << rate(ifclk * row.count / ev.cycles);
+		else	std::cout << '-';
+		std::cout << '\n';
+	}
+	std::cout << std::right;
+
+	const double gints = ifclk * ev.gint / ev.cycles;
+	if ( ifclk > 0 && gints > gint_max )
+		std::cout << "*** WARNING: " << rate(gints) << " GINT/s exceeds " << rate(gint_max)
+			<< "/s, the 8051 cannot keep up with the GPIFWF interrupts\n";
+}
+
+//////////////////////////////////////////////////////////////////////
+// --idle: latencies around the idle state and its output edges
+//////////////////////////////////////////////////////////////////////
+
+// Level of CTL line n for output byte: '0', '1' or 'Z' (TRICTL 1, OEn 0)
+static char
+line_level(uint8_t byte,unsigned n) {
+	if ( trictl && !((byte >> (n + 4)) & 1) )
+		return 'Z';
+	return (byte >> n) & 1 ? '1' : '0';
+}
+
+static const char *
+line_edge(char from,char to) {
+	if ( from == to )
+		return "-";
+	if ( to == 'Z' )
+		return "to Z";
+	if ( from == 'Z' )
+		return to == '1' ? "drive 1" : "drive 0";
+	return to == '1' ? "rise" : "fall";
+}
+
+static void
+analyze_idle(const s_analysis& an) {
+	const s_state *states = an.states;
+	const unsigned lines = trictl ? 4 : 6;
+	s_node start = { { 0, 0, false }, uint8_t(idlectl) };
+	std::map<uint32_t,bool> seen;
+	std::deque<s_node> queue;
+	std::vector<s_node> next;
+	std::vector<unsigned> before;		// States entering idle
+
+	machine_reset(start.m,states);
+
+	// States from which idle is entered, over all inputs
+	seen[node_key(start)] = true;
+	queue.push_back(start);
+	while ( !queue.empty() ) {
+		s_node n = queue.front();
+		queue.pop_front();
+
+		if ( n.m.state >= 7 )
+			continue;
+		successors(n,states,next);
+		for ( auto& s : next ) {
+			if ( s.m.state >= 7 && std::find(before.begin(),before.end(),n.m.state) == before.end() )
+				before.push_back(n.m.state);
+			if ( !seen[node_key(s)] ) {
+				seen[node_key(s)] = true;
+				queue.push_back(s);
+			}
+		}
+	}
+	std::sort(before.begin(),before.end());
+
+	Predicate strobe = [states](const s_node& n) {
+		return (machine_actions(n.m,states) & 0x02) != 0;
+	};
+	Predicate edge = [states](const s_node& n) {
+		return n.m.state < 7 && states[n.m.state].output.byte != n.prevout;
+	};
+	s_reach rs = reach(start,states,strobe);
+	s_reach re = reach(start,states,edge);
+
+	std::cout << ";\n; Idle transitions, GPIFIDLECTL 0x" << std::hex << std::uppercase << std::setw(2)
+		<< std::setfill('0') << idlectl << std::dec << std::nouppercase << std::setfill(' ')
+		<< ", TRICTL " << trictl << ", cycles from the first cycle of $0\n;\n"
+		<< "; trigger to first DATA strobe: " << range(rs) << '\n'
+		<< "; trigger to first CTL edge: " << range(re) << '\n';
+
+	// Last strobe to idle and the dead time of a restart for the inputs
+	s_machine m;
+	unsigned cycle = 0, first = unbounded, last = unbounded;
+
+	machine_reset(m,states);
+	while ( m.state < 7 && cycle < 0x10000 ) {
+		if ( machine_actions(m,states) & 0x02 ) {
+			if ( first == unbounded )
+				first = cycle;
+			last = cycle;
+		}
+		machine_step(m,states,inputs);
+		++cycle;
+	}
+	std::cout << "; inputs 0x" << std::hex << std::setw(2) << std::setfill('0') << inputs
+		<< std::dec << std::setfill(' ') << ": ";
+	if ( m.state < 7 )
+		std::cout << "not idle after " << cycle << " cycles, no restart\n";
+	else if ( last == unbounded )
+		std::cout << "idle after " << cycles(cycle) << ", no DATA strobe\n";
+	else	std::cout << "last DATA strobe to idle " << cycles(cycle - last)
+			<< ", restart dead time " << cycles(cycle - last + first)
+			<< " + retrigger\n";
+
+	// Output edges at the trigger and entering idle
+	std::cout << ";\n" << std::left << std::setw(7) << "line" << std::setw(6) << "idle"
+		<< std::setw(5) << "$0" << std::setw(12) << "trigger";
+	for ( auto sx : before )
+		std::cout << std::setw(5) << ('$' + std::to_string(sx)) << std::setw(12) << "to idle";
+	std::cout << '\n';
+
+	std::vector<std::string> glitches;
+
+	for ( unsigned lx=0; lx<lines; ++lx ) {
+		const char idle = line_level(idlectl,lx), first_level = line_level(states[0].output.byte,lx);
+		const std::string name = "CTL" + std::to_string(lx);
+
+		std::cout << std::setw(7) << name << std::setw(6) << idle << std::setw(5) << first_level
+			<< std::setw(12) << line_edge(idle,first_level);
+		for ( auto sx : before ) {
+			const char level = line_level(states[sx].output.byte,lx);
+
+			std::cout << std::setw(5) << level << std::setw(12) << line_edge(level,idle);
+			if ( level != idle && level == first_level )
+				glitches.push_back(name + " pulses " + idle + " while idle between $"
+					+ std::to_string(sx) + " and $0");
+		}
+		std::cout << '\n';
+	}
+	std::cout << std::right;
+	if ( before.empty() )
+		std::cout << "; never goes idle\n";
+	for ( auto& g : glitches )
+		std::cout << "*** WARNING: " << g << ", a glitch on a restart\n";
+}
+
+//////////////////////////////////////////////////////////////////////
+// --cpu: 8051 instruction cycles per transaction of a servicing
+// pattern. The sequences are what a tight firmware loop or handler
+// executes, MOVX with the default stretch (2 cycles), SYNCDELAY as 3
+// NOPs, the poll loop costs one round after DONE.
+//////////////////////////////////////////////////////////////////////
+
+struct s_insn {
+	const char		*text;
+	unsigned		cycles;		// 8051 instruction cycles
+};
+
+enum class Part {
+	Block,			// Once per --tc transactions
+	Serial,			// Between DONE and the next trigger
+	Handler,		// Per GINT interrupt
+};
+
+struct s_step {
+	Part			part;
+	s_insn			insn;
+};
+
+static const std::vector<s_insn> poll_done = {
+	{ "MOV DPTR,#GPIFTRIG",		3 },
+	{ "MOVX A,@DPTR",		2 },
+	{ "JNB ACC.7,poll",		4 },
+};
+
+static const std::vector<s_insn> trigger_fifo = {
+	{ "MOV DPTR,#EP2GPIFTRIG",	3 },
+	{ "MOVX @DPTR,A",		2 },
+};
+
+static const std::vector<s_insn> trigger_sgl = {
+	{ "MOV DPTR,#XAUTODAT1",	3 },
+	{ "MOVX A,@DPTR",		2 },
+	{ "MOV DPTR,#XGPIFSGLDATLX",	3 },
+	{ "MOVX @DPTR,A",		2 },
+};
+
+static const std::vector<s_insn> arm_tc = {
+	{ "MOV DPTR,#GPIFTCB1",		3 },
+	{ "MOV A,#tc>>8",		2 },
+	{ "MOVX @DPTR,A",		2 },
+	{ "SYNCDELAY",			3 },
+	{ "MOV DPTR,#GPIFTCB0",		3 },
+	{ "MOV A,#tc",			2 },
+	{ "MOVX @DPTR,A",		2 },
+	{ "SYNCDELAY",			3 },
+};
+
+static const std::vector<s_insn> isr_entry = {
+	{ "(vector, LCALL)",		4 },
+	{ "LJMP isr (INT4 autovector)",	4 },
+	{ "PUSH ACC",			2 },
+	{ "PUSH DPL",			2 },
+	{ "PUSH DPH",			2 },
+	{ "ANL EXIF,#0xEF",		3 },
+	{ "MOV DPTR,#GPIFIRQ",		3 },
+	{ "MOV A,#bit",			2 },
+	{ "MOVX @DPTR,A",		2 },
+};
+
+static const std::vector<s_insn> isr_exit = {
+	{ "POP DPH",			2 },
+	{ "POP DPL",			2 },
+	{ "POP ACC",			2 },
+	{ "RETI",			4 },
+};
+
+static void
+add(std::vector<s_step>& steps,Part part,const std::vector<s_insn>& insns) {
+	for ( auto& insn : insns )
+		steps.push_back({ part, insn });
+}
+
+static std::string
+cpu_time(double c) {
+	std::stringstream ss;
+
+	ss << std::fixed << std::setprecision(1) << c << " (" << c * 4e9 / cpuclk << "ns)";
+	return ss.str();
+}
+
+static void
+analyze_cpu(const s_analysis& an,const std::string& pattern) {
+	const s_state *states = an.states;
+	bool sgl = false;
+	std::vector<s_step> steps;
+
+	for ( unsigned sx=0; sx<7; ++sx )
+		sgl |= states[sx].opcode.bits().sgl && (states[sx].opcode.bits().data || states[sx].opcode.bits().next);
+
+	// Transaction for the inputs: cycles to idle, GINTs on the way
+	s_machine m;
+	unsigned cycle = 0, gints = 0, strobes = 0;
+
+	machine_reset(m,states);
+	while ( m.state < 7 && cycle < 0x10000 ) {
+		const uint8_t actions = machine_actions(m,states);
+
+		gints += (actions & 0x10) != 0;
+		strobes += (actions & 0x02) != 0;
+		machine_step(m,states,inputs);
+		++cycle;
+	}
+
+	std::cout << ";\n; 8051 cost, pattern " << pattern << ", CPU " << cpuclk / 1e6
+		<< " MHz (4 clocks per instruction cycle)\n";
+	if ( m.state < 7 ) {
+		std::cout << "; inputs 0x" << std::hex << std::setw(2) << std::setfill('0') << inputs
+			<< std::dec << std::setfill(' ') << ": not idle after " << cycle
+			<< " cycles, a free running waveform needs no 8051 per transaction\n";
+		return;
+	}
+
+	if ( pattern == "fifo" ) {
+		if ( sgl )
+			std::cout << "*** WARNING: SGL data states, the fifo pattern moves no SGLDAT\n";
+		add(steps,Part::Block,arm_tc);
+		add(steps,Part::Block,trigger_fifo);
+		add(steps,Part::Block,poll_done);
+	} else if ( pattern == "retrigger" ) {
+		add(steps,Part::Serial,poll_done);
+		add(steps,Part::Serial,sgl ? trigger_sgl : trigger_fifo);
+		add(steps,Part::Serial,{ { "DJNZ R7,loop", 3 } });
+	} else	{
+		add(steps,Part::Serial,isr_entry);
+		add(steps,Part::Serial,sgl ? trigger_sgl : trigger_fifo);
+		add(steps,Part::Serial,isr_exit);
+	}
+	if ( gints ) {
+		add(steps,Part::Handler,isr_entry);
+		add(steps,Part::Handler,{ { "(GPIFWF work)", 0 } });
+		add(steps,Part::Handler,isr_exit);
+	}
+
+	// Listing and sums
+	const char *partnames[3] = { "per trigger", "per transaction", "per GINT" };
+	unsigned sums[3] = { 0, 0, 0 };
+
+	std::cout << ";\n" << std::left << std::setw(28) << "instruction" << std::setw(8) << "cycles" << "counted\n";
+	for ( auto& step : steps ) {
+		std::cout << std::setw(28) << step.insn.text << std::setw(8) << step.insn.cycles
+			<< partnames[int(step.part)] << '\n';
+		sums[int(step.part)] += step.insn.cycles;
+	}
+	std::cout << std::right;
+
+	const unsigned long block = pattern == "fifo" ? std::max(tc,1ul) : 1;
+	const double serial = double(sums[int(Part::Block)]) / block + sums[int(Part::Serial)];
+	const double load = serial + double(sums[int(Part::Handler)]) * gints;
+	const double gpif = cycle + (pattern == "fifo" ? 1 : 0);	// Restart through idle
+
+	std::cout << ";\n; inputs 0x" << std::hex << std::setw(2) << std::setfill('0') << inputs
+		<< std::dec << std::setfill(' ') << ": cycles from trigger to idle " << cycles(cycle);
+	if ( pattern == "fifo" )
+		std::cout << " + 1 to restart, " << block << " transactions per trigger";
+	std::cout << ", " << strobes << " DATA, " << gints << " GINT\n"
+		<< "; 8051 instruction cycles per transaction: " << cpu_time(serial);
+	if ( gints )
+		std::cout << ", " << cpu_time(load) << " with the GINT handlers";
+	std::cout << '\n';
+
+	if ( ifclk <= 0 ) {
+		std::cout << "; IFCLK unknown, use --ifclk=hz to compare\n";
+		return;
+	}
+
+	const double gpif_ns = gpif * 1e9 / ifclk, serial_ns = serial * 4e9 / cpuclk, load_ns = load * 4e9 / cpuclk;
+	const double period = std::max(gpif_ns + serial_ns,load_ns);
+	const bool cpu_bound = serial_ns > gpif_ns || load_ns > gpif_ns + serial_ns;
+
+	std::cout << "; transaction period " << std::fixed << std::setprecision(1) << period << "ns, "
+		<< rate(1e9 / period) << " transactions/s, " << rate(1e9 * strobes / period) << " DATA/s\n"
+		<< "; " << (cpu_bound ? "CPU-bound" : "GPIF-bound") << ": the GPIF runs "
+		<< std::setprecision(0) << 100 * gpif_ns / period << "% of the period";
+	if ( cpu_bound )
+		std::cout << ", a faster waveform gains at most " << std::setprecision(2)
+			<< period / std::max(period - gpif_ns,load_ns) << 'x';
+	std::cout << std::defaultfloat << '\n';
+}
+
+int
+main(int argc,char **argv) {
+	std::string spec, error;
+	std::string cpu;
+	bool rdy = false, sgl = false, events = false, idle = false;
+	s_analysis an;
+
+	for ( int ax=1; ax < argc; ++ax ) {
+		if ( !strcmp(argv[ax],"--rdy") )
+			rdy = true;
+		else if ( !strcmp(argv[ax],"--sgl") )
+			sgl = true;
+		else if ( !strcmp(argv[ax],"--events") )
+			events = true;
+		else if ( !strcmp(argv[ax],"--idle") )
+			idle = true;
+		else if ( !strcmp(argv[ax],"--cpu=fifo") || !strcmp(argv[ax],"--cpu=retrigger")
+		  || !strcmp(argv[ax],"--cpu=interrupt") )
+			cpu = argv[ax] + 6;
+		else if ( !strncmp(argv[ax],"--cpuclk=",9) )
+			cpuclk = strtod(argv[ax]+9,nullptr);
+		else if ( !strncmp(argv[ax],"--tc=",5) )
+			tc = strtoul(argv[ax]+5,nullptr,0);
+		else if ( !strncmp(argv[ax],"--idlectl=",10) )
+			idlectl = strtoul(argv[ax]+10,nullptr,0) & 0xFF;
+		else if ( !strcmp(argv[ax],"--trictl=0") || !strcmp(argv[ax],"--trictl=1") )
+			trictl = argv[ax][9] == '1';
+		else if ( !strncmp(argv[ax],"--gint-max=",11) )
+			gint_max = strtod(argv[ax]+11,nullptr);
+		else if ( !strncmp(argv[ax],"--inputs=",9) )
+			inputs = strtoul(argv[ax]+9,nullptr,0) & 0xFF;
+		else if ( !strncmp(argv[ax],"--addr=",7) )
+			address = strtoul(argv[ax]+7,nullptr,0);
+		else if ( !strncmp(argv[ax],"--ifclk=",8) )
+			ifclk = strtod(argv[ax]+8,nullptr);
+		else if ( argv[ax][0] != '-' && spec.empty() )
+			spec = argv[ax];
+		else	{
+			spec.clear();
+			break;
+		}
+	}
+	if ( spec.empty() || !(rdy || sgl || events || idle || !cpu.empty()) || cpuclk <= 0 ) {
+		std::cerr << "Usage: " << argv[0] << " [--ifclk=hz] [--inputs=n] [--addr=n] [--gint-max=n]\n"
+			<< "       [--idlectl=n] [--trictl=0|1] [--cpuclk=hz] [--tc=n]\n"
+			<< "       {--rdy|--sgl|--events|--idle|--cpu=fifo|retrigger|interrupt}... file.inc[:name]\n";
+		exit(2);
+	}
+	if ( !select_table(spec,an.table,error) ) {
+		std::cerr << "*** ERROR: " << error << '\n';
+		exit(1);
+	}
+	table_states(an.table,an.states);
+	if ( ifclk <= 0 && an.table.ifconfig >= 0 && (an.table.ifconfig & 0x80) )
+		ifclk = an.table.ifconfig & 0x40 ? 48e6 : 30e6;
+
+	std::cout << "; Waveform " << an.table.name << " (" << an.table.file << "), IFCLK ";
+	if ( ifclk > 0 )
+		std::cout << ifclk / 1e6 << " MHz\n";
+	else	std::cout << "unknown, use --ifclk=hz\n";
+
+	if ( rdy )
+		analyze_rdy(an);
+	if ( sgl )
+		analyze_sgl(an);
+	if ( events )
+		analyze_events(an);
+	if ( idle )
+		analyze_idle(an);
+	if ( !cpu.empty() )
+		analyze_cpu(an,cpu);
+	return 0;
+}
+
+// End gpif_analyze.cpp
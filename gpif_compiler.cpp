@@ -5,7 +5,20 @@
 //
 // This is a simple assember, to generate wave tables. This program
 // accepts the source code from stdin and generates the C code on
-// stdout. Listing and errors are put to stderr.
+// stdout. Listing and errors are put to stderr. Source files given
+// as arguments are compiled one after the other instead (batch mode).
+// A source holds any number of waveforms, each section starting with
+// .WAVEFORM or .RATES is emitted as soon as it is closed.
+//
+// OPTIONS:
+//
+//	--listing=text		Listing for humans (default)
+//	--listing=json		One JSON object per line and waveform
+//	--rate-table		Append a sorted rate descriptor array
+//	--init			Emit the GPIF register init block per table
+//	--stats			Time, heap allocations per phase to stderr
+//	--serve[=socket]	Compile server on stdin/stdout or Unix socket,
+//				one connection at a time
 //
 // SOURCE CODE FORMAT (UPPERCASE ONLY):
 //
@@ -26,11 +39,63 @@
 //	.EPXGPIFFLGSEL	{ PF | EF | FF }	; Selected FIFO flag
 //	.EP		{ 2 | 4 | 6 | 8 }	; Default 2
 //	.WAVEFORM	n			; Names output C code array
+//	.RATES		rate1 rate2 ...		; Rate sweep, e.g. 20K 500K 1M
+//	.CONSTRAINT	check			; Timing check, see CONSTRAINTS
+//	.IFCLKHZ	hz			; External IFCLK, e.g. 25M (5M..48M)
+//	.ROUNDING	{ UP | NEAREST | DOWN }	; Time counts to cycles, default UP
+//	.GPIFREADYCFG6	{ 0 | 1 }		; SAS, RDY synchronous to IFCLK, default 0
+//	.GPIFIDLECTL	n			; CTL/OE levels in idle, default 0xFF
+//	.IDLEDRV	{ 0 | 1 }		; Drive the data bus in idle, default 0
 //
 // NDP OPCODES:
 //	[S][+][G][D][N]		[count=1] [OEn] [CTLn]
 // or	Z			[count=1] [OEn] [CTLn]
 //
+// COUNTS:
+//	The count is a number or an expression without blanks, e.g.
+//	CYCLES/2-1, using + - * / % ( ) and the numbers with optional
+//	K or M suffix. IFCLK is the internal clock frequency, with .RATES
+//	RATE is the sample rate and CYCLES = IFCLK/RATE. Counts above 256
+//	are split into several states with the same outputs, the opcode
+//	flags act on the first of them; $n targets name the n-th opcode
+//	line of the source, $7 the idle state.
+//
+//	A number with NS or US suffix is a time, e.g. 35NS, 2US or 20.8NS,
+//	converted with the IFCLK frequency (.3048MHZ, or .IFCLKHZ with
+//	.IFCLKSRC 0). A count with a time is evaluated exactly and rounded
+//	to cycles once, by .ROUNDING: UP is the fewest cycles lasting at
+//	least the time. The listing shows the exact cycles and the error.
+//
+// CONSTRAINTS:
+//	.CONSTRAINT	CTLn HIGH|LOW op time	; Every pulse of CTLn
+//	.CONSTRAINT	DATA AFTER CTLn RISE|FALL op time
+//						; From the last edge to DATA
+//	.CONSTRAINT	DATA BEFORE CTLn RISE|FALL op time
+//						; From DATA to the next edge
+//	op is >= > <= <, time is a number with NS, US or CYCLE(S), e.g.
+//	10NS or 1 CYCLE. The CTL levels are traced cycle by cycle (a line
+//	tri-stated by OEn has no level) for each constant input vector,
+//	only complete pulses count. NS needs the internal IFCLK. A
+//	violation is an error, in a rate sweep the rate is rejected.
+//
+// INIT BLOCK:
+//	--init emits gpif_init_n[ count ][ 3 ] after each waveform_n, the
+//	XDATA address (high, low byte) and value of IFCONFIG, GPIFREADYCFG,
+//	GPIFCTLCFG, GPIFIDLECS, GPIFIDLECTL and EPxGPIFFLGSEL of .EP, for
+//	one copy loop in the firmware (FX2 only).
+//
+// RATE TABLE:
+//	--rate-table appends gpif_rates[], all tables compiled by the run
+//	sorted by their rate (from the waveform name, see RATE SWEEP), and
+//	gpif_rate_select(rate_hz), a binary search for the nearest rate.
+//
+// RATE SWEEP:
+//	With .RATES the body is compiled once for each rate and emitted
+//	as waveform_n / ifconfig_n, n = MS/s or 100 + kS/s / 10. The clock
+//	selected by .3048MHZ is used if the rate is an integral number of
+//	its cycles, else the other one. Rates that cannot be reached within
+//	7 states are rejected.
+//
 // DP OPCODES:
 //	J[S][+][G][D][N][*]   	A OP B [OEn] [CTLn] $1 $2
 // where:
@@ -54,7 +119,12 @@
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
+#include <math.h>
 #include <assert.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 
 #include <iostream>
 #include <iomanip>
@@ -65,6 +135,9 @@
 #include <map>
 #include <array>
 #include "gpif.h"
+#include "gpif_ctl.h"
+#include "gpif_sim.h"
+#include "gpif_stats.h"
 
 
 enum class PseudoOps {
@@ -77,6 +150,13 @@ enum class PseudoOps {
 	EpxGpifFlgSel,		// PF, EF or FF
 	Ep,			// 2, 4, 6 or 8
 	WaveForm,		// x
+	Rates,			// rate sweep, not part of the environment
+	Constraint,		// timing check, not part of the environment
+	IfClkHz,		// external IFCLK frequency, only when given
+	Rounding,		// UP, NEAREST or DOWN, only when given
+	GpifReadyCfg6,		// SAS, only when given
+	GpifIdleCtl,		// idle CTL/OE levels, only when given
+	IdleDrv,		// GPIFIDLECS.7, only when given
 };
 
 static const std::map<std::string,int> pseudotab = {
@@ -89,6 +169,13 @@ static const std::map<std::string,int> pseudotab = {
 	{ ".EPXGPIFFLGSEL",	int(PseudoOps::EpxGpifFlgSel) },
 	{ ".EP",		int(PseudoOps::Ep) },
 	{ ".WAVEFORM",		int(PseudoOps::WaveForm) },
+	{ ".RATES",		int(PseudoOps::Rates) },
+	{ ".CONSTRAINT",	int(PseudoOps::Constraint) },
+	{ ".IFCLKHZ",		int(PseudoOps::IfClkHz) },
+	{ ".ROUNDING",		int(PseudoOps::Rounding) },
+	{ ".GPIFREADYCFG6",	int(PseudoOps::GpifReadyCfg6) },
+	{ ".GPIFIDLECTL",	int(PseudoOps::GpifIdleCtl) },
+	{ ".IDLEDRV",		int(PseudoOps::IdleDrv) },
 };
 
 static const std::map<std::string,int> flgsel = {
@@ -97,27 +184,17 @@ static const std::map<std::string,int> flgsel = {
 	{ "FF", 2 },
 };
 
-static const std::map<unsigned,std::map<std::string,unsigned>> oetab = {
-	{ 0, {			// TRICTL=0
-		{ "CTL5", 5 },
-		{ "CTL4", 4 },
-		{ "CTL3", 3 },
-		{ "CTL2", 2 },
-		{ "CTL1", 1 },
-		{ "CTL0", 0 },
-	  }
-	},
-	{ 1, {			// TRICTL=1
-		{ "OE3",  7 },
-		{ "OE2",  6 },
-		{ "OE1",  5 },
-		{ "OE0",  4 },
-		{ "CTL3", 3 },
-		{ "CTL2", 2 },
-		{ "CTL1", 1 },
-		{ "CTL0", 0 },
-	  }
-	}
+// Time counts to cycles
+enum class Rounding {
+	Up,			// Fewest cycles lasting at least the time
+	Nearest,
+	Down,
+};
+
+static const std::map<std::string,int> roundtab = {
+	{ "UP",		int(Rounding::Up) },
+	{ "NEAREST",	int(Rounding::Nearest) },
+	{ "DOWN",	int(Rounding::Down) },
 };
 
 static const std::map<std::string,unsigned> functab = {
@@ -272,6 +349,9 @@ struct s_instr {
 	u_opcode		opcode;
 	u_logfunc		logfunc;
 	u_output		output;
+	unsigned		count;		// NDP cycles, may exceed 256 until split
+	double			exact;		// Exact cycles of a count with a time, else 0
+	unsigned		line;		// Source line number
 
 	void clear() {
 		stropcode.clear();
@@ -281,166 +361,374 @@ struct s_instr {
 		logfunc.byte = 0;
 		branch.byte = 0;
 		output.byte = 0;
+		count = 0;
+		exact = 0;
+		line = 0;
 	};
 };
 
-static bool
-parse(std::istream& istr,s_instr& instr) {
-	std::stringstream ss;
-	char pk;
+// Symbols usable in count expressions (RATE, CYCLES, IFCLK)
+typedef std::map<std::string,long long> Symbols;
 
-	instr.clear();
+//////////////////////////////////////////////////////////////////////
+// Count expressions: integers with optional K/M suffix, times with
+// NS/US suffix, symbols, + - * / % and parentheses. No whitespace
+// (operands are tokens). Each value is kept as an integer and as a
+// real number of cycles: without a time the integer counts, as
+// before, with one the real value is rounded once at the end.
+//////////////////////////////////////////////////////////////////////
 
-	for (;;) {
-		if ( istr.eof() )
-			return false;
-		istr >> instr.stropcode;
-		if ( instr.stropcode[0] != ';' && !instr.stropcode.empty() )
-			break;
-		while ( !istr.eof() && istr.get() != '\n' )
-			;
+struct s_value {
+	long long		v;		// Integer arithmetic
+	double			x;		// Real arithmetic, times in cycles
+};
+
+struct s_expr {
+	const std::string&	text;
+	const Symbols&		syms;
+	size_t			pos;
+	bool			timed;		// A time was used
+	bool			zero;		// Integer division by zero
+	std::string		error;
+
+	s_expr(const std::string& t,const Symbols& s) : text(t), syms(s), pos(0), timed(false), zero(false) {}
+
+	char peek() const {
+		return pos < text.size() ? text[pos] : 0;
 	}
 
-	while ( !istr.eof() && (pk = istr.peek()) != '\n' ) {
-		std::string token;
+	// Time literal in cycles of IFCLK
+	s_value time(double ns) {
+		auto it = syms.find("IFCLK");
 
-		istr >> token;
-		if ( token[0] != ';' ) {
-			instr.stroperands.push_back(token);
-		} else	{
-			while ( (pk = istr.peek()) != '\n' ) {
-				ss << pk;
-				istr.get();
+		timed = true;
+		if ( it == syms.end() || it->second <= 0 ) {
+			if ( error.empty() )
+				error = "a time needs the IFCLK frequency (.IFCLKSRC 1 or .IFCLKHZ)";
+			return { 0, 0 };
+		}
+		return { 0, ns * it->second / 1e9 };
+	}
+
+	s_value primary() {
+		char c = peek();
+
+		if ( c == '(' ) {
+			++pos;
+			s_value v = sum();
+			if ( peek() != ')' ) {
+				if ( error.empty() )
+					error = "missing ')'";
+				return { 0, 0 };
 			}
-			if ( ss.tellp() > 0 )
-				instr.strcomment = ss.str();
-			break;
+			++pos;
+			return v;
+		} else if ( c == '-' ) {
+			++pos;
+			s_value v = primary();
+			return { -v.v, -v.x };
+		} else if ( c >= '0' && c <= '9' ) {
+			size_t start = pos;
+			long long v = 0;
+
+			while ( (c = peek()) >= '0' && c <= '9' ) {
+				v = v * 10 + (c - '0');
+				++pos;
+			}
+			if ( peek() == '.' ) {			// Only for times
+				++pos;
+				while ( (c = peek()) >= '0' && c <= '9' )
+					++pos;
+			}
+			if ( !text.compare(pos,2,"NS") || !text.compare(pos,2,"US") ) {
+				const double t = strtod(text.c_str() + start,nullptr);
+				const bool us = text[pos] == 'U';
+
+				pos += 2;
+				return time(us ? t * 1000.0 : t);
+			} else if ( text.find('.',start) < pos ) {
+				if ( error.empty() )
+					error = "a fraction needs NS or US";
+				return { 0, 0 };
+			}
+			switch ( peek() ) {
+			case 'K':
+			case 'k':
+				++pos;
+				v *= 1000;
+				break;
+			case 'M':
+				++pos;
+				v *= 1000000;
+				break;
+			}
+			return { v, double(v) };
+		} else if ( c >= 'A' && c <= 'Z' ) {
+			size_t start = pos;
+
+			while ( ((c = peek()) >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') )
+				++pos;
+			std::string name = text.substr(start,pos-start);
+			auto it = syms.find(name);
+			if ( it == syms.end() ) {
+				if ( error.empty() )
+					error = "undefined symbol '" + name + "'";
+				return { 0, 0 };
+			}
+			return { it->second, double(it->second) };
 		}
+		if ( error.empty() )
+			error = "syntax error";
+		return { 0, 0 };
 	}
 
-	while ( !istr.eof() ) {
-		if ( istr.get() == '\n' )
-			break;
+	s_value product() {
+		s_value v = primary();
+
+		for (;;) {
+			char c = peek();
+			if ( c != '*' && c != '/' && c != '%' )
+				return v;
+			++pos;
+			s_value r = primary();
+			if ( c == '*' ) {
+				v.v *= r.v;
+				v.x *= r.x;
+			} else if ( r.x == 0 ) {
+				if ( error.empty() )
+					error = "division by zero";
+				return { 0, 0 };
+			} else if ( !r.v ) {
+				zero = true;		// An error unless timed
+				v.v = 0;
+				v.x = c == '/' ? v.x / r.x : fmod(v.x,r.x);
+			} else if ( c == '/' ) {
+				v.v /= r.v;
+				v.x /= r.x;
+			} else	{
+				v.v %= r.v;
+				v.x = fmod(v.x,r.x);
+			}
+		}
+	}
+
+	s_value sum() {
+		s_value v = product();
+
+		for (;;) {
+			char c = peek();
+			if ( c != '+' && c != '-' )
+				return v;
+			++pos;
+			s_value r = product();
+			if ( c == '+' ) {
+				v.v += r.v;
+				v.x += r.x;
+			} else	{
+				v.v -= r.v;
+				v.x -= r.x;
+			}
+		}
+	}
+};
+
+// Exact cycles to a count
+static long long
+round_cycles(double exact,Rounding rounding) {
+	switch ( rounding ) {
+	case Rounding::Nearest:
+		return llround(exact);
+	case Rounding::Down:
+		return (long long)floor(exact + 1e-9);
+	case Rounding::Up:
+		break;
+	}
+	return (long long)ceil(exact - 1e-9);
+}
+
+// Evaluate text, with a time rounded by rounding and its exact cycles
+// to *exact (else 0)
+static bool
+evaluate(const std::string& text,const Symbols& syms,long long& value,std::string& error,
+  Rounding rounding = Rounding::Up,double *exact = nullptr) {
+	s_expr expr(text,syms);
+	s_value v = expr.sum();
+
+	if ( expr.error.empty() && expr.pos != text.size() )
+		expr.error = "syntax error";
+	if ( expr.error.empty() && expr.zero && !expr.timed )
+		expr.error = "division by zero";
+	if ( !expr.error.empty() ) {
+		std::stringstream ss;
+		ss << "Invalid count '" << text << "': " << expr.error;
+		error = ss.str();
+		return false;
 	}
+	value = expr.timed ? round_cycles(v.x,rounding) : v.v;
+	if ( exact )
+		*exact = expr.timed ? v.x : 0;
 	return true;
 }
 
-int
-main(int argc,char **argv) {
+static bool
+is_expression(const std::string& operand,const Symbols& syms) {
+	if ( operand.empty() )
+		return false;
+	if ( (operand[0] >= '0' && operand[0] <= '9') || operand[0] == '(' )
+		return true;
+	for ( auto& pair : syms )
+		if ( !operand.compare(0,pair.first.size(),pair.first) )
+			return true;
+	return false;
+}
 
-	std::vector<s_instr> instrs;
-	std::map<unsigned,unsigned> environ = {
-		{ unsigned(PseudoOps::IfClkSrc),	1u },
-		{ unsigned(PseudoOps::MHz3048),		0u },
-		{ unsigned(PseudoOps::IfClkOE),		0u },
-		{ unsigned(PseudoOps::Trictl),		0u },
-		{ unsigned(PseudoOps::GpifReadyCfg5),	0u },
-		{ unsigned(PseudoOps::GpifReadyCfg7),	0u },
-		{ unsigned(PseudoOps::EpxGpifFlgSel),	0u },
-		{ unsigned(PseudoOps::Ep),		2u },
-		{ unsigned(PseudoOps::WaveForm),	0u },
-	};
-	unsigned& ifclksrc = environ.at(unsigned(PseudoOps::IfClkSrc));
-	unsigned& mhz3048 = environ.at(unsigned(PseudoOps::MHz3048));
-	unsigned& ifclkoe = environ.at(unsigned(PseudoOps::IfClkOE));
-	unsigned& trictl = environ.at(unsigned(PseudoOps::Trictl));
-	unsigned& gpifreadycfg5 = environ.at(unsigned(PseudoOps::GpifReadyCfg5));
-	unsigned& gpifreadycfg7 = environ.at(unsigned(PseudoOps::GpifReadyCfg7));
-	unsigned& epxgpifflgsel= environ.at(unsigned(PseudoOps::EpxGpifFlgSel));
-	unsigned& waveformx= environ.at(unsigned(PseudoOps::WaveForm));
-	unsigned state = 0;
-        unsigned ifconfig = 0;
+static std::string
+json_escape(const std::string& text) {
+	std::string out;
 
-	{
-		s_instr instr;
+	for ( auto c : text ) {
+		switch ( c ) {
+		case '"':
+			out += "\\\"";
+			break;
+		case '\\':
+			out += "\\\\";
+			break;
+		case '\t':
+			out += "\\t";
+			break;
+		case '\r':
+			out += "\\r";
+			break;
+		case '\n':
+			out += "\\n";
+			break;
+		default:
+			out += c;
+		}
+	}
+	return out;
+}
 
-		while ( parse(std::cin,instr) ) {
-			auto it = pseudotab.find(instr.stropcode);
-			if ( it != pseudotab.end() ) {
-				PseudoOps pseudoop = PseudoOps(it->second);
-				char *ep;
-				unsigned value = 0;
+static bool
+parse(std::istream& istr,s_instr& instr,unsigned& lineno) {
+	std::string line;
 
-				if ( instr.stroperands.size() != 1 ) {
-					std::cerr << "*** ERROR: Only one operand valid for pseudo op " << instr.stropcode << '\n';
-					exit(1);
-				}
-				if ( pseudoop != PseudoOps::EpxGpifFlgSel ) { // numeric values
-					value = strtoul(instr.stroperands[0].c_str(),&ep,10);
-					bool fail = false;
+	instr.clear();
 
-					if ( pseudoop != PseudoOps::WaveForm ) { // valid: 0/1 or 2/4/6/8
-						fail = value > ( pseudoop != PseudoOps::Ep ? 1 : 8 );
+	while ( std::getline(istr,line) ) {
+		std::istringstream ls(line);
+		std::string token;
 
-						if ( !fail && pseudoop == PseudoOps::Ep && (value & 1) )
-							fail = true;		// Only EP 2, 4, 6 or 8
-					} else	fail = false;
+		++lineno;
+		if ( !(ls >> instr.stropcode) || instr.stropcode[0] == ';' )
+			continue;
+		instr.line = lineno;
 
-					if ( (ep && *ep) || fail ) {
-						std::cerr << "*** ERROR: Invalid operand '" << instr.stroperands[0] << "' for " << instr.stropcode << '\n';
-						exit(1);
-					}
-				} else	{
-					auto it = flgsel.find(instr.stroperands[0]);
-					if ( it == flgsel.end() ) {
-						std::cerr << "*** ERROR: Operand of " << instr.stropcode << " must be PF, EF, or FF\n";
-						exit(1);
-					}
-					value = !!it->second;
-				}
-				environ[unsigned(pseudoop)] = value;
-				continue;
+		while ( ls >> token ) {
+			if ( token[0] != ';' ) {
+				instr.stroperands.push_back(token);
 			} else	{
-				instrs.push_back(instr);
+				std::string comment;
+
+				std::getline(ls,comment);
+				if ( !comment.empty() )
+					instr.strcomment = comment;
+				break;
 			}
 		}
+		return true;
 	}
+	return false;
+}
 
-	ifconfig = ( ifclksrc << 7 | mhz3048 << 6 | ifclkoe << 5 | 0x0a );
+//////////////////////////////////////////////////////////////////////
+// Encode opcodes and operands of all instructions
+//////////////////////////////////////////////////////////////////////
 
-	for ( auto& instr : instrs ) {
-		// Parse opcode:
-		for ( auto c : instr.stropcode ) {
-			switch ( c ) {
-			case 'J':
-				instr.opcode.bits.dp = 1;
-				break;
-			case 'S':
-				instr.opcode.bits.sgl = 1;
-				break;
-			case '+':
-				instr.opcode.bits.incad = 1;
-				break;
-			case 'G':
-				instr.opcode.bits.gint = 1;
-				break;
-			case 'N':
-				instr.opcode.bits.next = 1;
-				break;
-			case 'D':
-				instr.opcode.bits.data = 1;
-				break;
-			case 'Z':
+// Parse the opcode characters
+static void
+opcode_flags(s_instr& instr) {
+	for ( auto c : instr.stropcode ) {
+		switch ( c ) {
+		case 'J':
+			instr.opcode.bits().dp = 1;
+			break;
+		case 'S':
+			instr.opcode.bits().sgl = 1;
+			break;
+		case '+':
+			instr.opcode.bits().incad = 1;
+			break;
+		case 'G':
+			instr.opcode.bits().gint = 1;
+			break;
+		case 'N':
+			instr.opcode.bits().next = 1;
+			break;
+		case 'D':
+			instr.opcode.bits().data = 1;
+			break;
+		case 'Z':
+			break;
+		case '*':
+			if ( instr.opcode.bits().dp ) {
+				instr.branch.bits().reexecute = 1;
 				break;
-			case '*':
-				if ( instr.opcode.bits.dp ) {
-					instr.branch.bits.reexecute = 1;
-					break;
-				}
-				// Fall thru
-			default:
-				{
-					std::stringstream ss;
+			}
+			// Fall thru
+		default:
+			{
+				std::stringstream ss;
 
-					ss << "Unknown opcode '" << c << "'";
-					instr.error = ss.str();
-				}
+				ss << "Unknown opcode '" << c << "'";
+				instr.error = ss.str();
 			}
 		}
+	}
+}
+
+// .ROUNDING in effect
+static Rounding
+rounding_of(const std::map<unsigned,unsigned>& environ) {
+	auto it = environ.find(unsigned(PseudoOps::Rounding));
+
+	return it == environ.end() ? Rounding::Up : Rounding(it->second);
+}
+
+// NDP count operand, 0 == 256 as on the FX2
+static void
+count_operand(s_instr& instr,const std::string& operand,const Symbols& syms,long long max,Rounding rounding) {
+	long long count;
+	std::stringstream ss;
+	bool literal = strspn(operand.c_str(),"0123456789") == operand.size();
+
+	if ( !evaluate(operand,syms,count,instr.error,rounding,&instr.exact) ) {
+		return;
+	} else if ( count > max || count < 0 || (count == 0 && !literal) ) {
+		ss << "Invalid count value " << count;
+		instr.error = ss.str();
+	} else	{
+		if ( count == 0 )
+			count = 256u;
+		instr.count = count;
+	}
+}
+
+static void
+assemble(std::vector<s_instr>& instrs,const std::map<unsigned,unsigned>& environ,const Symbols& syms) {
+	const unsigned trictl = environ.at(unsigned(PseudoOps::Trictl));
+	const unsigned gpifreadycfg5 = environ.at(unsigned(PseudoOps::GpifReadyCfg5));
+	const unsigned gpifreadycfg7 = environ.at(unsigned(PseudoOps::GpifReadyCfg7));
+	const unsigned epxgpifflgsel= environ.at(unsigned(PseudoOps::EpxGpifFlgSel));
+
+	for ( auto& instr : instrs ) {
+		opcode_flags(instr);
 
 		// Parse operands:
-		if ( instr.opcode.bits.dp ) {
+		if ( instr.opcode.bits().dp ) {
 			// DP
+			instr.count = 1;
 			if ( instr.stroperands.size() < 3 ) {
 				instr.error = "missing operand A func B";
 				continue;
@@ -458,7 +746,7 @@ main(int argc,char **argv) {
 					instr.error = ss.str();
 					continue;
 				}
-				instr.logfunc.bits.terma = it->second;
+				instr.logfunc.bits().terma = it->second;
 			}
 
 			{
@@ -472,7 +760,7 @@ main(int argc,char **argv) {
 					instr.error = ss.str();
 					continue;
 				}
-				instr.logfunc.bits.termb = it->second;
+				instr.logfunc.bits().termb = it->second;
 			}
 
 			{
@@ -484,10 +772,10 @@ main(int argc,char **argv) {
 					instr.error = ss.str();
 					continue;
 				}
-				instr.logfunc.bits.lfunc = it->second;
+				instr.logfunc.bits().lfunc = it->second;
 			}
 
-			instr.branch.bits.branchon0 = instr.branch.bits.branchon1 = 7;	// Default to state 7
+			instr.branch.bits().branchon0 = instr.branch.bits().branchon1 = 7;	// Default to state 7
 			unsigned statex = 0;
 
 			for ( unsigned ox=3; ox<instr.stroperands.size(); ++ox ) {
@@ -507,10 +795,10 @@ main(int argc,char **argv) {
 
 					switch ( statex++ ) {
 					case 0: // 1st target (if true)
-						instr.branch.bits.branchon1 = state;
+						instr.branch.bits().branchon1 = state;
 						break;
 					case 1: // 2nd target (if false)
-						instr.branch.bits.branchon0 = state;
+						instr.branch.bits().branchon0 = state;
 						break;
 					default:
 						{
@@ -542,30 +830,18 @@ main(int argc,char **argv) {
 			}
 		} else	{
 			// NDP
-			instr.branch.byte = 1;		// Default to a 1-count
+			instr.count = 1;		// Default to a 1-count
 
 			for ( auto& operand : instr.stroperands ) {
-				if ( operand[0] >= '0' && operand[0] <= '9' ) {
-					// Count
-					char *ep;
-					unsigned count = strtoul(operand.c_str(),&ep,10);
-					std::stringstream ss;
+				const auto& oemap = oetab.at(trictl);
 
-					if ( ep && *ep ) {
-						ss << "Invalid count '" << operand << "'";
-						instr.error = ss.str();
-					} else if ( count > 256 ) {
-						ss << "Invalid count value " << count;
-						instr.error = ss.str();
-					} else	{
-						if ( count == 256 )
-							count = 0u;
-						instr.branch.byte = count;
-					}
+				if ( oemap.find(operand) == oemap.end() && is_expression(operand,syms) ) {
+					// Count
+					count_operand(instr,operand,syms,256 * 7,rounding_of(environ));
+					if ( !instr.error.empty() )
+						break;
 				} else	{
 					// Bits
-					const auto& oemap = oetab.at(trictl);
-
 					auto it = oemap.find(operand);
 					if ( it == oemap.end() ) {
 						std::stringstream ss;
@@ -582,19 +858,288 @@ main(int argc,char **argv) {
 			}
 		}
 	}
+}
+
+//////////////////////////////////////////////////////////////////////
+// Split NDP counts > 256 into consecutive states with the same
+// outputs. The opcode flags act on the first of these states only,
+// the others are Z. Branch targets $n name source instructions and
+// are remapped to the first state generated for instruction n, $7 is
+// the idle state. Any other $n past the last instruction is an error.
+//////////////////////////////////////////////////////////////////////
+
+static std::vector<s_instr>
+expand(const std::vector<s_instr>& instrs) {
+	std::vector<s_instr> states;
+	std::vector<unsigned> first;
+
+	for ( auto& instr : instrs ) {
+		first.push_back(states.size());
+		if ( instr.opcode.bits().dp ) {
+			states.push_back(instr);
+			continue;
+		}
 
-	auto revlookup = [&](unsigned ps) -> std::string {
-		for ( auto pair : pseudotab ) {
-			const std::string& op = pair.first;
-			const unsigned u = pair.second;
+		const unsigned n = (instr.count + 255) / 256;	// Spread evenly
+		s_instr state = instr;
 
-			if ( ps == u )
-				return op;
+		for ( unsigned x=0; x<n; ++x ) {
+			unsigned chunk = instr.count / n + ( x < instr.count % n ? 1 : 0 );
+
+			state.branch.byte = chunk == 256 ? 0 : chunk;
+			states.push_back(state);
+			state.opcode.byte = 0;
+			state.stropcode = "Z";
+			state.strcomment = "(cont.)";
+			state.exact = 0;
+			state.error.clear();
 		}
-		assert(0);
+	}
+
+	auto remap = [&](s_instr& state,unsigned target) -> unsigned {
+		if ( target < first.size() )
+			return first[target];
+		if ( target != 7 && state.error.empty() )
+			state.error = "target state $" + std::to_string(target) + " names no instruction";
+		return target;
 	};
 
-	std::cerr << ";\n;\tEnvironment in effect:\n"
+	for ( auto& state : states ) {
+		if ( !state.opcode.bits().dp )
+			continue;
+		state.branch.bits().branchon0 = remap(state,state.branch.bits().branchon0);
+		state.branch.bits().branchon1 = remap(state,state.branch.bits().branchon1);
+	}
+	return states;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Listing to stderr, returns false if the table is unusable
+//////////////////////////////////////////////////////////////////////
+
+enum class Listing {
+	Text,
+	Json,
+};
+
+static Listing listing_format = Listing::Text;
+
+// --stats
+enum Phase {
+	PhaseLex,
+	PhasePseudo,
+	PhaseEncode,
+	PhaseListing,
+	PhaseEmit,
+};
+
+static bool stats = false;
+static std::vector<s_phase> phases = {
+	{ "lex",	0, 0, 0 },
+	{ "pseudo-ops",	0, 0, 0 },
+	{ "encode",	0, 0, 0 },
+	{ "listing",	0, 0, 0 },
+	{ "emit",	0, 0, 0 },
+};
+static unsigned long long ntokens = 0;
+static unsigned long long ninstrs = 0;
+
+// Registered with atexit() by --stats, so every exit path reports
+static void
+finish() {
+	print_stats(phases,{ { "tokens", ntokens }, { "instructions", ninstrs } },
+		listing_format == Listing::Json);
+}
+
+static std::string
+revlookup(unsigned ps) {
+	for ( auto pair : pseudotab ) {
+		const std::string& op = pair.first;
+		const unsigned u = pair.second;
+
+		if ( ps == u )
+			return op;
+	}
+	assert(0);
+	return "";
+}
+
+// Error outside of a table listing
+static void
+report(std::ostream& diag,const std::string& error) {
+	if ( listing_format == Listing::Json )
+		diag << "{\"errors\":[\"" << json_escape(error) << "\"]}\n";
+	else	diag << "*** ERROR: " << error << '\n';
+}
+
+
+static unsigned long
+ifclk_hz(const std::map<unsigned,unsigned>& environ) {
+	if ( !environ.at(unsigned(PseudoOps::IfClkSrc)) ) {
+		auto it = environ.find(unsigned(PseudoOps::IfClkHz));
+
+		return it == environ.end() ? 0 : it->second;	// External, 0 if unknown
+	}
+	return environ.at(unsigned(PseudoOps::MHz3048)) ? 48000000ul : 30000000ul;
+}
+
+// Listing line for a count given as a time: exact cycles and the
+// quantization error of the rounded count
+static std::string
+quantization(const s_instr& instr,unsigned long ifclk,Rounding rounding) {
+	static const char *names[] = { "up", "to nearest", "down" };
+	std::stringstream ss;
+
+	if ( instr.exact <= 0 || !ifclk )
+		return "";
+	ss << ";\t\t" << std::fixed << std::setprecision(3) << instr.exact << " cycles rounded "
+		<< names[int(rounding)] << " to " << instr.count << ", "
+		<< std::showpos << std::setprecision(1) << (instr.count - instr.exact) * 1e9 / ifclk << " ns\n";
+	return ss.str();
+}
+
+//////////////////////////////////////////////////////////////////////
+// Machine readable listing, one JSON object per line and waveform
+//////////////////////////////////////////////////////////////////////
+
+static bool
+listing_json(std::ostream& diag,const std::vector<s_instr>& states,const std::map<unsigned,unsigned>& environ) {
+	const unsigned trictl = environ.at(unsigned(PseudoOps::Trictl));
+	const auto& opermap = opertab.at(environ.at(unsigned(PseudoOps::GpifReadyCfg5)))
+		.at(environ.at(unsigned(PseudoOps::EpxGpifFlgSel)))
+		.at(environ.at(unsigned(PseudoOps::GpifReadyCfg7)));
+	const std::array<const char *,3> opers = { { "PF", "EF", "FF" } };
+	const std::array<const char *,4> funcs = { { "AND", "OR", "XOR", "/AND" } };
+	const std::array<const char *,3> rounds = { { "UP", "NEAREST", "DOWN" } };
+	const unsigned long ifclk = ifclk_hz(environ);
+	std::vector<std::string> errors;
+	std::stringstream js;
+	bool ok = true;
+
+	auto hex = [](unsigned byte) -> std::string {
+		char buf[8];
+		snprintf(buf,sizeof buf,"%02X",byte & 0xFF);
+		return buf;
+	};
+	auto term = [&](unsigned code) -> std::string {
+		for ( auto& pair : opermap )
+			if ( pair.second == code )
+				return pair.first;
+		return "?";
+	};
+
+	js << "{\"environment\":{";
+	for ( auto it = environ.begin(); it != environ.end(); ++it ) {
+		if ( it != environ.begin() )
+			js << ',';
+		js << '"' << revlookup(it->first) << "\":";
+		if ( PseudoOps(it->first) == PseudoOps::EpxGpifFlgSel )
+			js << '"' << opers[it->second] << '"';
+		else if ( PseudoOps(it->first) == PseudoOps::Rounding )
+			js << '"' << rounds[it->second] << '"';
+		else	js << it->second;
+	}
+	js << "},\"states\":[";
+
+	for ( unsigned statex=0; statex<states.size(); ++statex ) {
+		const s_instr& instr = states[statex];
+		const bool dp = instr.opcode.bits().dp;
+		s_state st = { instr.branch, instr.opcode, instr.logfunc, instr.output };
+
+		if ( statex )
+			js << ',';
+		js << "{\"state\":" << statex
+			<< ",\"line\":" << instr.line
+			<< ",\"opcode\":\"" << json_escape(instr.stropcode) << '"'
+			<< ",\"operands\":[";
+		for ( unsigned ox=0; ox<instr.stroperands.size(); ++ox )
+			js << (ox ? ",\"" : "\"") << json_escape(instr.stroperands[ox]) << '"';
+		js << "],\"comment\":\"" << json_escape(instr.strcomment) << '"'
+			<< ",\"bytes\":[\"" << hex(instr.branch.byte) << "\",\"" << hex(instr.opcode.byte)
+			<< "\",\"" << hex(instr.logfunc.byte) << "\",\"" << hex(instr.output.byte) << "\"]"
+			<< ",\"dp\":" << (dp ? "true" : "false")
+			<< ",\"sgl\":" << unsigned(instr.opcode.bits().sgl)
+			<< ",\"incad\":" << unsigned(instr.opcode.bits().incad)
+			<< ",\"gint\":" << unsigned(instr.opcode.bits().gint)
+			<< ",\"data\":" << unsigned(instr.opcode.bits().data)
+			<< ",\"next\":" << unsigned(instr.opcode.bits().next)
+			<< ",\"cycles\":" << state_cycles(st);
+		if ( instr.exact > 0 && ifclk )
+			js << std::fixed << std::setprecision(3) << ",\"exact_cycles\":" << instr.exact
+				<< ",\"quantization_ns\":" << (instr.count - instr.exact) * 1e9 / ifclk;
+		if ( dp ) {
+			js << ",\"a\":\"" << term(instr.logfunc.bits().terma) << '"'
+				<< ",\"func\":\"" << funcs[instr.logfunc.bits().lfunc] << '"'
+				<< ",\"b\":\"" << term(instr.logfunc.bits().termb) << '"'
+				<< ",\"then\":" << unsigned(instr.branch.bits().branchon1)
+				<< ",\"else\":" << unsigned(instr.branch.bits().branchon0)
+				<< ",\"reexecute\":" << unsigned(instr.branch.bits().reexecute);
+		}
+		js << ",\"outputs\":{";
+		bool first = true;
+		for ( auto& pair : oetab.at(trictl) ) {
+			js << (first ? "\"" : ",\"") << pair.first << "\":" << ((instr.output.byte >> pair.second) & 1);
+			first = false;
+		}
+		js << "},\"error\":";
+		if ( instr.error.empty() )
+			js << "null}";
+		else	{
+			js << '"' << json_escape(instr.error) << "\"}";
+			ok = false;
+		}
+	}
+	js << ']';
+
+	if ( states.size() > 7 ) {
+		errors.push_back("Too many states. Limit is 6 states max.");
+		ok = false;
+	} else	{
+		s_state table[7];
+
+		memset(table,0,sizeof table);
+		for ( unsigned statex=0; statex<states.size(); ++statex ) {
+			table[statex].branch = states[statex].branch;
+			table[statex].opcode = states[statex].opcode;
+			table[statex].logfunc = states[statex].logfunc;
+			table[statex].output = states[statex].output;
+		}
+		s_loop loop = find_loop(table);
+
+		js << ",\"loop\":{\"deterministic\":" << (loop.deterministic ? "true" : "false");
+		if ( loop.deterministic ) {
+			js << ",\"idle\":" << (loop.idle ? "true" : "false")
+				<< ",\"start\":" << loop.start
+				<< ",\"period_cycles\":" << loop.period
+				<< ",\"data_strobes\":" << loop.strobes;
+			if ( ifclk )
+				js << ",\"ifclk_hz\":" << ifclk << std::fixed << std::setprecision(3)
+					<< ",\"period_ns\":" << 1e9 * loop.period / ifclk
+					<< ",\"rate_hz\":" << double(ifclk) / loop.period;
+		}
+		js << '}';
+	}
+
+	js << ",\"errors\":[";
+	for ( unsigned ex=0; ex<errors.size(); ++ex )
+		js << (ex ? ",\"" : "\"") << json_escape(errors[ex]) << '"';
+	js << "]}\n";
+
+	diag << js.str();
+	return ok;
+}
+
+static bool
+listing(std::ostream& diag,const std::vector<s_instr>& states,const std::map<unsigned,unsigned>& environ) {
+	const unsigned long ifclk = ifclk_hz(environ);
+	const Rounding rounding = rounding_of(environ);
+	unsigned state = 0;
+	bool ok = true;
+
+	if ( listing_format == Listing::Json )
+		return listing_json(diag,states,environ);
+
+	diag << ";\n;\tEnvironment in effect:\n"
 		<< ";\n";
 
 	for ( auto& pair : environ ) {
@@ -602,6 +1147,7 @@ main(int argc,char **argv) {
 		const unsigned value = pair.second;
 		const std::string& op = revlookup(ps);
 		const std::array<const char *,3> opers = { { "PF", "EF", "FF" } };
+		const std::array<const char *,3> rounds = { { "UP", "NEAREST", "DOWN" } };
 
 		switch ( PseudoOps(ps) ) {
 		case PseudoOps::IfClkSrc:
@@ -612,90 +1158,1042 @@ main(int argc,char **argv) {
 		case PseudoOps::GpifReadyCfg7:
 		case PseudoOps::Ep:
 		case PseudoOps::WaveForm:
-			std::cerr << '\t' << op << '\t' << value << '\n';
+		case PseudoOps::IfClkHz:
+		case PseudoOps::GpifReadyCfg6:
+		case PseudoOps::IdleDrv:
+			diag << '\t' << op << '\t' << std::dec << value << '\n';
+			break;
+		case PseudoOps::GpifIdleCtl:
+			diag << '\t' << op << "\t0x" << std::hex << std::uppercase << std::setw(2) << std::setfill('0')
+				<< value << std::dec << std::nouppercase << '\n';
 			break;
 		case PseudoOps::EpxGpifFlgSel:
-			std::cerr << '\t' << op << '\t' << opers[value] << '\n';
+			diag << '\t' << op << '\t' << opers[value] << '\n';
+			break;
+		case PseudoOps::Rounding:
+			diag << '\t' << op << '\t' << rounds[value] << '\n';
+			break;
+		case PseudoOps::Rates:
+		case PseudoOps::Constraint:
 			break;
 		}
 	}
-	std::cerr << ";\n";
+	diag << ";\n";
 
-	for ( auto& instr : instrs ) {
-		std::cerr << '$' << state++ << "  ";
+	for ( auto& instr : states ) {
+		diag << '$' << std::dec << state++ << "  ";
 
-		std::cerr.width(2);
-		std::cerr.fill('0');
-		std::cerr << std::uppercase << std::hex << unsigned(instr.branch.byte);
+		diag.width(2);
+		diag.fill('0');
+		diag << std::uppercase << std::hex << unsigned(instr.branch.byte);
 
-		std::cerr.fill('0');
-		std::cerr.width(2);
-		std::cerr << std::hex << unsigned(instr.opcode.byte);
+		diag.fill('0');
+		diag.width(2);
+		diag << std::hex << unsigned(instr.opcode.byte);
 
-		std::cerr.width(2);
-		std::cerr.fill('0');
-		std::cerr << std::hex << unsigned(instr.logfunc.byte);
+		diag.width(2);
+		diag.fill('0');
+		diag << std::hex << unsigned(instr.logfunc.byte);
 
-		std::cerr.fill('0');
-		std::cerr.width(2);
-		std::cerr << std::hex << unsigned(instr.output.byte);
+		diag.fill('0');
+		diag.width(2);
+		diag << std::hex << unsigned(instr.output.byte);
 
-		std::cerr << '\t' << instr.stropcode << '\t';
+		diag << '\t' << instr.stropcode << '\t';
 		for ( auto& operand : instr.stroperands )
-			std::cerr << operand << " ";
+			diag << operand << " ";
 		if ( !instr.strcomment.empty() )
-			std::cerr << "\t; " << instr.strcomment;
-		std::cerr << '\n';
-		if ( !instr.error.empty() )
-			std::cerr << "*** ERROR: " << instr.error << '\n';
+			diag << "\t; " << instr.strcomment;
+		diag << '\n' << quantization(instr,ifclk,rounding);
+		if ( !instr.error.empty() ) {
+			diag << "*** ERROR: " << instr.error << '\n';
+			ok = false;
+		}
 		if ( state > 7 ) {
-			std::cerr << "*** ERROR: Too many states. Limit is 6 states max.\n";
-			exit(1);
+			diag << "*** ERROR: Too many states. Limit is 6 states max.\n";
+			return false;
 		}
 	}
+	diag << std::dec;
+	return ok;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Emit the C code to stdout, collect the table
+//////////////////////////////////////////////////////////////////////
+
+static bool collect_tables = false;	// For --rate-table and --serve
+
+struct s_table {
+	unsigned		waveformx;
+	unsigned		ifconfig;
+	uint8_t			bytes[32];	// In C array order
+};
+
+static void
+emit(std::ostream& out,std::vector<s_instr> instrs,unsigned waveformx,unsigned ifconfig,std::vector<s_table>& tables) {
+	s_table table;
 
 	instrs.resize(8);
 
-	std::cout << "#define ifconfig_" << waveformx << " 0x";
-	std::cout.width(2);
-	std::cout.fill('0');
-	std::cout << std::hex << ifconfig << std::dec << "\n\n";
+	table.waveformx = waveformx;
+	table.ifconfig = ifconfig;
+	for ( unsigned ux=0; ux<8; ++ux ) {
+		table.bytes[ux] = instrs[ux].branch.byte;
+		table.bytes[ux+8] = instrs[ux].opcode.byte;
+		table.bytes[ux+16] = instrs[ux].output.byte;
+		table.bytes[ux+24] = instrs[ux].logfunc.byte;
+	}
+	if ( collect_tables )
+		tables.push_back(table);
+
+	out << "#define ifconfig_" << waveformx << " 0x";
+	out.width(2);
+	out.fill('0');
+	out << std::hex << ifconfig << std::dec << "\n\n";
 
-	std::cout << "static const unsigned char waveform_" << waveformx << "[ 32 ] = {\n\t";
+	out << "static const unsigned char waveform_" << waveformx << "[ 32 ] = {\n\t";
 	for ( auto& instr : instrs ) {
-		std::cout << "0x";
-		std::cout.width(2);
-		std::cout.fill('0');
-		std::cout << std::uppercase << std::hex << unsigned(instr.branch.byte) << ',';
+		out << "0x";
+		out.width(2);
+		out.fill('0');
+		out << std::uppercase << std::hex << unsigned(instr.branch.byte) << ',';
 	}
-	std::cout << "\n\t";
+	out << "\n\t";
 
 	for ( auto& instr : instrs ) {
-		std::cout << "0x";
-		std::cout.fill('0');
-		std::cout.width(2);
-		std::cout << std::hex << unsigned(instr.opcode.byte) << ',';
+		out << "0x";
+		out.fill('0');
+		out.width(2);
+		out << std::hex << unsigned(instr.opcode.byte) << ',';
 	}
-	std::cout << "\n\t";
+	out << "\n\t";
 
 	for ( auto& instr : instrs ) {
-		std::cout << "0x";
-		std::cout.fill('0');
-		std::cout.width(2);
-		std::cout << std::hex << unsigned(instr.output.byte) << ',';
+		out << "0x";
+		out.fill('0');
+		out.width(2);
+		out << std::hex << unsigned(instr.output.byte) << ',';
 	}
-	std::cout << "\n\t";
+	out << "\n\t";
 
 	for ( auto& instr : instrs ) {
-		std::cout << "0x";
-		std::cout.width(2);
-		std::cout.fill('0');
-		std::cout << std::hex << unsigned(instr.logfunc.byte) << ',';
+		out << "0x";
+		out.width(2);
+		out.fill('0');
+		out << std::hex << unsigned(instr.logfunc.byte) << ',';
+	}
+
+	out << "\n};\n\n" << std::dec << std::nouppercase;
+}
+
+//////////////////////////////////////////////////////////////////////
+// --init: the registers the table was compiled for, as XDATA address
+// and value triples in the order the firmware should write them
+//////////////////////////////////////////////////////////////////////
+
+static bool init_block = false;
+
+static void
+emit_init(std::ostream& out,unsigned waveformx,unsigned ifconfig,const std::map<unsigned,unsigned>& environ) {
+	auto optional = [&](PseudoOps ps,unsigned dflt) -> unsigned {
+		auto it = environ.find(unsigned(ps));
+		return it == environ.end() ? dflt : it->second;
+	};
+	const unsigned ep = environ.at(unsigned(PseudoOps::Ep));
+	const struct {
+		unsigned	address;
+		unsigned	value;
+		std::string	name;
+	} regs[] = {
+		{ 0xE601, ifconfig,					"IFCONFIG" },
+		{ 0xE6F3, environ.at(unsigned(PseudoOps::GpifReadyCfg7)) << 7
+			| optional(PseudoOps::GpifReadyCfg6,0) << 6
+			| environ.at(unsigned(PseudoOps::GpifReadyCfg5)) << 5,	"GPIFREADYCFG" },
+		{ 0xE6C3, environ.at(unsigned(PseudoOps::Trictl)) << 7,	"GPIFCTLCFG" },
+		{ 0xE6C1, optional(PseudoOps::IdleDrv,0) << 7,		"GPIFIDLECS" },
+		{ 0xE6C2, optional(PseudoOps::GpifIdleCtl,0xFF),	"GPIFIDLECTL" },
+		{ 0xE6D2 + (ep - 2) * 4, environ.at(unsigned(PseudoOps::EpxGpifFlgSel)),
+			"EP" + std::to_string(ep) + "GPIFFLGSEL" },
+	};
+	const unsigned count = sizeof regs / sizeof regs[0];
+
+	out << "#define gpif_init_" << waveformx << "_count " << count << "\n\n"
+		<< "static const unsigned char gpif_init_" << waveformx << "[ " << count << " ][ 3 ] = {\n"
+		<< std::uppercase << std::hex;
+	for ( auto& reg : regs ) {
+		out << "\t{ 0x" << std::setw(2) << std::setfill('0') << (reg.address >> 8)
+			<< ",0x" << std::setw(2) << (reg.address & 0xFF)
+			<< ",0x" << std::setw(2) << reg.value << " },\t// " << reg.name << '\n';
+	}
+	out << "};\n\n" << std::dec << std::nouppercase;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Rate sweep support
+//////////////////////////////////////////////////////////////////////
+
+// Naming convention: MS/s -> n, kS/s -> 100 + n/10 (20 kS/s -> 102)
+static bool
+rate_name(unsigned long rate,unsigned& name) {
+	if ( rate >= 1000000 && rate % 1000000 == 0 && rate / 1000000 < 100 ) {
+		name = rate / 1000000;
+		return true;
+	}
+	if ( rate < 1000000 && rate >= 10000 && rate % 10000 == 0 ) {
+		name = 100 + rate / 10000;
+		return true;
+	}
+	return false;
+}
+
+// Inverse of rate_name(), 0 if the name follows no rate
+static unsigned long
+name_rate(unsigned name) {
+	if ( name >= 1 && name < 100 )
+		return name * 1000000ul;
+	if ( name > 100 && name < 200 )
+		return (name - 100) * 10000ul;
+	return 0;
+}
+
+// Pick the internal clock giving an integral number of cycles,
+// preferring the one selected by .3048MHZ
+static bool
+rate_clock(unsigned long rate,unsigned& mhz3048,unsigned long& ifclk) {
+	for ( unsigned pass=0; pass<2; ++pass, mhz3048 ^= 1 ) {
+		ifclk = mhz3048 ? 48000000ul : 30000000ul;
+		if ( rate > 0 && rate <= ifclk && ifclk % rate == 0 )
+			return true;
+	}
+	return false;
+}
+
+//////////////////////////////////////////////////////////////////////
+// .CONSTRAINT: pulse widths and DATA setup/hold, checked against the
+// cycle by cycle CTL trace of the table
+//////////////////////////////////////////////////////////////////////
+
+struct s_constraint {
+	std::string		text;		// As written
+	bool			data;		// DATA AFTER/BEFORE edge
+	bool			after;		// DATA AFTER edge
+	unsigned		line;		// CTLn
+	bool			high;		// HIGH pulse / RISE edge
+	std::string		op;		// >= > <= <
+	double			value;
+	bool			ns;		// value in ns, else cycles
+};
+
+struct s_cycle {
+	int			level[6];	// CTLn: 0, 1, -1 == not driven
+	bool			data;
+};
+
+static bool
+parse_constraint(const std::vector<std::string>& operands,s_constraint& c,std::string& error) {
+	std::vector<std::string> t = operands;
+	size_t x = 0;
+
+	auto line = [&](const std::string& name) -> bool {
+		char *ep;
+		if ( name.compare(0,3,"CTL") || name.size() != 4 )
+			return false;
+		c.line = strtoul(name.c_str()+3,&ep,10);
+		return !*ep && c.line <= 5;
+	};
+
+	for ( auto& operand : operands )
+		c.text += (c.text.empty() ? "" : " ") + operand;
+	error = "Invalid .CONSTRAINT '" + c.text + "'";
+
+	c.data = t.size() > 0 && t[0] == "DATA";
+	if ( c.data ) {
+		if ( t.size() < 4 || (t[1] != "AFTER" && t[1] != "BEFORE") || !line(t[2])
+		  || (t[3] != "RISE" && t[3] != "FALL") )
+			return false;
+		c.after = t[1] == "AFTER";
+		c.high = t[3] == "RISE";
+		x = 4;
+	} else	{
+		if ( t.size() < 2 || !line(t[0]) || (t[1] != "HIGH" && t[1] != "LOW") )
+			return false;
+		c.high = t[1] == "HIGH";
+		x = 2;
+	}
+	if ( x >= t.size() || (t[x] != ">=" && t[x] != ">" && t[x] != "<=" && t[x] != "<") )
+		return false;
+	c.op = t[x++];
+	if ( x >= t.size() )
+		return false;
+
+	char *ep;
+	std::string unit;
+
+	c.value = strtod(t[x].c_str(),&ep);
+	if ( ep == t[x].c_str() || c.value < 0 )
+		return false;
+	unit = ep;
+	if ( unit.empty() && ++x < t.size() )
+		unit = t[x];
+	if ( unit == "NS" || unit == "US" ) {
+		c.ns = true;
+		if ( unit == "US" )
+			c.value *= 1000.0;
+	} else if ( unit == "CYCLE" || unit == "CYCLES" )
+		c.ns = false;
+	else	return false;
+	if ( x + 1 < t.size() )
+		return false;
+	error.clear();
+	return true;
+}
+
+// CTL levels and DATA per cycle for constant inputs: the run to idle,
+// or the lead-in and the loop unrolled twice
+static void
+trace(const s_state table[8],unsigned trictl,unsigned inputs,std::vector<s_cycle>& cycles) {
+	std::map<uint32_t,size_t> seen;		// Machine state -> cycle
+	s_machine m;
+
+	cycles.clear();
+	machine_reset(m,table);
+	while ( m.state < 7 ) {
+		const uint32_t key = m.state | m.remain << 3 | uint32_t(m.fresh) << 12;
+		auto it = seen.find(key);
+
+		if ( it != seen.end() ) {
+			const size_t start = it->second, end = cycles.size();
+			for ( size_t cx=start; cx<end; ++cx )
+				cycles.push_back(cycles[cx]);
+			return;
+		}
+		seen[key] = cycles.size();
+
+		const uint8_t out = table[m.state].output.byte;
+		s_cycle c;
+
+		for ( unsigned l=0; l<6; ++l ) {
+			if ( trictl )
+				c.level[l] = l > 3 ? -1 : (out >> (l + 4) & 1) ? (out >> l & 1) : -1;
+			else	c.level[l] = out >> l & 1;
+		}
+		u_opcode actions;
+
+		actions.byte = machine_actions(m,table);
+		c.data = actions.bits().data;
+		cycles.push_back(c);
+		machine_step(m,table,inputs);
+	}
+}
+
+// Worst case of a constraint over a trace, false if nothing to measure
+static bool
+measure(const s_constraint& c,const std::vector<s_cycle>& cycles,bool lower,unsigned& worst) {
+	const int level = c.high ? 1 : 0;
+	bool found = false;
+
+	auto better = [&](unsigned v) {
+		if ( !found || (lower ? v < worst : v > worst) )
+			worst = v;
+		found = true;
+	};
+	// Edge at cx: the line takes level in cx and did not have it before
+	auto edge = [&](size_t cx) {
+		return cx > 0 && cycles[cx].level[c.line] == level && cycles[cx-1].level[c.line] != level;
+	};
+
+	if ( !c.data ) {
+		size_t start = 0;
+		bool open = true;		// Pulse began before the trace
+
+		for ( size_t cx=1; cx<=cycles.size(); ++cx ) {
+			if ( cx < cycles.size() && cycles[cx].level[c.line] == cycles[cx-1].level[c.line] )
+				continue;
+			if ( !open && cx < cycles.size() && cycles[start].level[c.line] == level )
+				better(cx - start);
+			start = cx;
+			open = false;
+		}
+		return found;
+	}
+
+	for ( size_t cx=0; cx<cycles.size(); ++cx ) {
+		if ( !cycles[cx].data )
+			continue;
+		if ( c.after ) {
+			for ( size_t ex=cx+1; ex-- > 1; ) {
+				if ( edge(ex) ) {
+					better(cx - ex);
+					break;
+				}
+			}
+		} else	{
+			for ( size_t ex=cx+1; ex<cycles.size(); ++ex ) {
+				if ( edge(ex) ) {
+					better(ex - cx);
+					break;
+				}
+			}
+		}
+	}
+	return found;
+}
+
+static bool
+check_constraints(std::ostream& diag,const std::vector<s_instr>& states,
+  const std::map<unsigned,unsigned>& environ,const std::vector<s_constraint>& constraints) {
+	const unsigned long ifclk = ifclk_hz(environ);
+	const unsigned trictl = environ.at(unsigned(PseudoOps::Trictl));
+	std::vector<s_cycle> cycles;
+	s_state table[8];
+	unsigned terms = 0;
+	bool ok = true;
+
+	if ( constraints.empty() || states.size() > 7 )
+		return true;
+	memset(table,0,sizeof table);
+	for ( unsigned statex=0; statex<states.size(); ++statex ) {
+		table[statex] = { states[statex].branch, states[statex].opcode, states[statex].logfunc, states[statex].output };
+		if ( table[statex].opcode.bits().dp )
+			terms |= 1u << table[statex].logfunc.bits().terma | 1u << table[statex].logfunc.bits().termb;
 	}
 
-	std::cout << "\n};\n\n";
+	if ( listing_format == Listing::Text )
+		diag << ";\n;\tConstraints:\n;\n";
+	for ( auto& c : constraints ) {
+		const bool lower = c.op[0] == '>';
+		unsigned worst = 0;
+		bool found = false;
+		unsigned inputs = 0;
+		std::stringstream ss;
+
+		if ( c.ns && !ifclk ) {
+			report(diag,"constraint '" + c.text + "' in ns needs the IFCLK frequency (.IFCLKSRC 1 or .IFCLKHZ)");
+			ok = false;
+			continue;
+		}
+		do	{			// Each combination of the tested terms
+			unsigned w;
+
+			trace(table,trictl,inputs,cycles);
+			if ( measure(c,cycles,lower,w) ) {
+				if ( !found || (lower ? w < worst : w > worst) )
+					worst = w;
+				found = true;
+			}
+			inputs = (inputs - terms) & terms;
+		} while ( inputs );
 
+		const double ns = ifclk ? worst * 1e9 / ifclk : 0;
+		const double v = c.ns ? ns : worst;
+		const bool met = !found
+			|| (c.op == ">=" ? v >= c.value - 1e-9 : c.op == ">" ? v > c.value
+			: c.op == "<=" ? v <= c.value + 1e-9 : v < c.value);
+
+		if ( found ) {
+			ss << worst << (worst == 1 ? " cycle" : " cycles");
+			if ( ifclk )
+				ss << " (" << std::fixed << std::setprecision(1) << ns << "ns)";
+		} else	ss << "not exercised";
+
+		if ( listing_format == Listing::Json )
+			diag << "{\"constraint\":\"" << json_escape(c.text) << "\",\"worst_cycles\":"
+				<< (found ? std::to_string(worst) : "null") << ",\"ok\":" << (met ? "true" : "false") << "}\n";
+		else if ( met )
+			diag << ";\t" << c.text << "\t" << (found ? (lower ? "min " : "max ") : "") << ss.str() << "\n";
+		else	diag << "*** ERROR: constraint '" << c.text << "' violated: " << ss.str() << '\n';
+		ok = ok && met;
+	}
+	return ok;
+}
+
+//////////////////////////////////////////////////////////////////////
+// --rate-table: the compiled tables as an array of rate descriptors
+// sorted by rate, and a binary search selecting the nearest rate, so
+// the firmware needs no switch over the waveform names.
+//////////////////////////////////////////////////////////////////////
+
+static int
+emit_rate_table(std::ostream& out,std::ostream& diag,const std::vector<s_table>& tables) {
+	std::map<unsigned long,unsigned> rates;	// rate -> waveform name
+
+	for ( auto& table : tables ) {
+		const unsigned long rate = name_rate(table.waveformx);
+
+		if ( !rate ) {
+			report(diag,"waveform_" + std::to_string(table.waveformx) + " has no rate by its name, not in the rate table");
+			continue;
+		}
+		if ( !rates.insert({ rate, table.waveformx }).second ) {
+			report(diag,"waveform_" + std::to_string(table.waveformx) + ": rate " + std::to_string(rate) + " compiled twice");
+			return 1;
+		}
+	}
+	if ( rates.empty() ) {
+		report(diag,"no waveform for the rate table");
+		return 1;
+	}
+
+	out << "struct gpif_rate {\n"
+		<< "\tunsigned long\t\trate_hz;\n"
+		<< "\tunsigned char\t\tifconfig;\n"
+		<< "\tconst unsigned char\t*waveform;\n"
+		<< "};\n\n"
+		<< "#define GPIF_RATES " << rates.size() << "\n\n"
+		<< "static const struct gpif_rate gpif_rates[ GPIF_RATES ] = {\n";
+	for ( auto& pair : rates )
+		out << "\t{ " << pair.first << "UL, ifconfig_" << pair.second << ", waveform_" << pair.second << " },\n";
+	out << "};\n\n"
+		<< "// Nearest supported rate, O(log n)\n"
+		<< "static const struct gpif_rate *\n"
+		<< "gpif_rate_select(unsigned long rate_hz) {\n"
+		<< "\tunsigned char lo = 0, hi = GPIF_RATES - 1;\n\n"
+		<< "\twhile ( lo < hi ) {\n"
+		<< "\t\tunsigned char mid = (lo + hi) / 2;\n\n"
+		<< "\t\tif ( gpif_rates[mid].rate_hz < rate_hz )\n"
+		<< "\t\t\tlo = mid + 1;\n"
+		<< "\t\telse\thi = mid;\n"
+		<< "\t}\n"
+		<< "\tif ( lo > 0 && gpif_rates[lo].rate_hz > rate_hz\n"
+		<< "\t  && rate_hz - gpif_rates[lo-1].rate_hz < gpif_rates[lo].rate_hz - rate_hz )\n"
+		<< "\t\t--lo;\n"
+		<< "\treturn &gpif_rates[lo];\n"
+		<< "}\n\n";
 	return 0;
 }
 
+//////////////////////////////////////////////////////////////////////
+// Compile one .WAVEFORM section (or rate sweep) of a source stream:
+// C code to out, listing and errors to diag. Returns the exit code.
+//////////////////////////////////////////////////////////////////////
+
+static int
+compile_section(std::ostream& out,std::ostream& diag,std::vector<s_instr>& instrs,
+  const std::map<unsigned,unsigned>& environ,const std::vector<unsigned long>& rates,
+  const std::vector<s_constraint>& constraints,std::vector<s_table>& tables) {
+	const unsigned ifclksrc = environ.at(unsigned(PseudoOps::IfClkSrc));
+	const unsigned mhz3048 = environ.at(unsigned(PseudoOps::MHz3048));
+	const unsigned ifclkoe = environ.at(unsigned(PseudoOps::IfClkOE));
+	const unsigned waveformx = environ.at(unsigned(PseudoOps::WaveForm));
+	unsigned ifconfig = 0;
+
+	if ( rates.empty() ) {
+		Symbols syms;
+		std::vector<s_instr> states;
+
+		if ( ifclk_hz(environ) )
+			syms["IFCLK"] = ifclk_hz(environ);
+		{
+			s_phase_timer timer(phases[PhaseEncode]);
+			assemble(instrs,environ,syms);
+			states = expand(instrs);
+			ninstrs += instrs.size();
+		}
+
+		ifconfig = ( ifclksrc << 7 | mhz3048 << 6 | ifclkoe << 5 | 0x0a );
+
+		bool ok;
+
+		{
+			s_phase_timer timer(phases[PhaseListing]);
+			ok = listing(diag,states,environ);
+			if ( !ok && states.size() > 7 )
+				return 1;
+			if ( !check_constraints(diag,states,environ,constraints) )
+				return 1;
+		}
+		{
+			// A table with errors in its states is still emitted,
+			// but the exit code says so
+			s_phase_timer timer(phases[PhaseEmit]);
+			emit(out,states,waveformx,ifconfig,tables);
+			if ( init_block )
+				emit_init(out,waveformx,ifconfig,environ);
+		}
+		return ok ? 0 : 1;
+	}
+
+	// Rate sweep: one table per rate from the same parameterized body
+	if ( !ifclksrc ) {
+		report(diag,".RATES needs the internal IFCLK (.IFCLKSRC 1)");
+		return 1;
+	}
+
+	int rc = 0;
+
+	for ( auto rate : rates ) {
+		std::map<unsigned,unsigned> env = environ;
+		std::vector<s_instr> body = instrs;
+		unsigned long ifclk = 0;
+		unsigned name = 0;
+		unsigned clk = mhz3048;
+
+		if ( !rate_name(rate,name) ) {
+			report(diag,"Rate " + std::to_string(rate) + " S/s has no waveform name, rejected");
+			rc = 1;
+			continue;
+		}
+		if ( !rate_clock(rate,clk,ifclk) ) {
+			report(diag,"Rate " + std::to_string(rate) + " S/s is no integral number of IFCLK cycles, rejected");
+			rc = 1;
+			continue;
+		}
+		env[unsigned(PseudoOps::MHz3048)] = clk;
+		env[unsigned(PseudoOps::WaveForm)] = name;
+
+		Symbols syms = {
+			{ "RATE",	rate },
+			{ "IFCLK",	ifclk },
+			{ "CYCLES",	ifclk / rate },
+		};
+
+		std::vector<s_instr> states;
+		bool ok;
+
+		{
+			s_phase_timer timer(phases[PhaseEncode]);
+			assemble(body,env,syms);
+			states = expand(body);
+			ninstrs += body.size();
+		}
+		{
+			s_phase_timer timer(phases[PhaseListing]);
+			ok = listing(diag,states,env);
+		}
+		if ( !ok ) {
+			if ( states.size() > 7 )
+				report(diag,"Rate " + std::to_string(rate) + " S/s cannot be reached within 7 states, rejected");
+			else	report(diag,"Rate " + std::to_string(rate) + " S/s has source errors, rejected");
+			rc = 1;
+			continue;
+		}
+		if ( !check_constraints(diag,states,env,constraints) ) {
+			report(diag,"Rate " + std::to_string(rate) + " S/s violates a .CONSTRAINT, rejected");
+			rc = 1;
+			continue;
+		}
+		ifconfig = ( ifclksrc << 7 | clk << 6 | ifclkoe << 5 | 0x0a );
+		{
+			s_phase_timer timer(phases[PhaseEmit]);
+			emit(out,states,name,ifconfig,tables);
+			if ( init_block )
+				emit_init(out,name,ifconfig,env);
+		}
+	}
+
+	return rc;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Compile one source stream: C code to out, listing and errors to
+// diag. instrs is a buffer kept by the caller. Returns the exit code.
+// Any pseudo op but .CONSTRAINT after instructions closes the section
+// before it, which is compiled and emitted at once. The next section
+// starts with no instructions, rates or constraints and the environment
+// in effect.
+//////////////////////////////////////////////////////////////////////
+
+static int
+compile(std::istream& src,std::ostream& out,std::ostream& diag,std::vector<s_instr>& instrs,std::vector<s_table>& tables) {
+	std::vector<unsigned long> rates;
+	std::vector<s_constraint> constraints;
+	std::map<unsigned,unsigned> environ = {
+		{ unsigned(PseudoOps::IfClkSrc),	1u },
+		{ unsigned(PseudoOps::MHz3048),		0u },
+		{ unsigned(PseudoOps::IfClkOE),		0u },
+		{ unsigned(PseudoOps::Trictl),		0u },
+		{ unsigned(PseudoOps::GpifReadyCfg5),	0u },
+		{ unsigned(PseudoOps::GpifReadyCfg7),	0u },
+		{ unsigned(PseudoOps::EpxGpifFlgSel),	0u },
+		{ unsigned(PseudoOps::Ep),		2u },
+		{ unsigned(PseudoOps::WaveForm),	0u },
+	};
+	bool compiled = false;		// A section was closed
+	int rc = 0;
+
+	// Compile and emit the section, start the next one
+	auto close_section = [&]() {
+		const int section_rc = compile_section(out,diag,instrs,environ,rates,constraints,tables);
+
+		out.flush();
+		instrs.clear();
+		rates.clear();
+		constraints.clear();
+		compiled = true;
+		return section_rc;
+	};
+
+	instrs.clear();
+
+	{
+		s_instr instr;
+		unsigned lineno = 0;
+
+		for (;;) {
+			{
+				s_phase_timer timer(phases[PhaseLex]);
+				if ( !parse(src,instr,lineno) )
+					break;
+			}
+			s_phase_timer timer(phases[PhasePseudo]);
+			ntokens += 1 + instr.stroperands.size();
+
+			auto it = pseudotab.find(instr.stropcode);
+			if ( it != pseudotab.end() ) {
+				PseudoOps pseudoop = PseudoOps(it->second);
+				char *ep;
+				unsigned value = 0;
+
+				if ( pseudoop == PseudoOps::Constraint ) {
+					s_constraint c;
+					std::string error;
+
+					if ( !parse_constraint(instr.stroperands,c,error) ) {
+						report(diag,error);
+						return 1;
+					}
+					constraints.push_back(c);
+					continue;
+				}
+				// Environment after instructions belongs to the next section
+				if ( !instrs.empty() && close_section() )
+					rc = 1;
+				if ( pseudoop == PseudoOps::Rates ) {
+					for ( auto& operand : instr.stroperands ) {
+						long long rate;
+						std::string error;
+
+						if ( !evaluate(operand,Symbols(),rate,error) || rate <= 0 ) {
+							report(diag,"Invalid rate '" + operand + "' for " + instr.stropcode);
+							return 1;
+						}
+						rates.push_back(rate);
+					}
+					if ( rates.empty() ) {
+						report(diag,"Missing rates for pseudo op " + instr.stropcode);
+						return 1;
+					}
+					continue;
+				}
+				if ( instr.stroperands.size() != 1 ) {
+					report(diag,"Only one operand valid for pseudo op " + instr.stropcode);
+					return 1;
+				}
+				if ( pseudoop == PseudoOps::IfClkHz ) {
+					long long hz;
+					std::string error;
+
+					if ( !evaluate(instr.stroperands[0],Symbols(),hz,error) || hz < 5000000 || hz > 48000000 ) {
+						report(diag,"Invalid operand '" + instr.stroperands[0] + "' for " + instr.stropcode + ", must be 5M..48M");
+						return 1;
+					}
+					environ[unsigned(pseudoop)] = hz;
+					continue;
+				}
+				if ( pseudoop == PseudoOps::Rounding ) {
+					auto it = roundtab.find(instr.stroperands[0]);
+					if ( it == roundtab.end() ) {
+						report(diag,"Operand of " + instr.stropcode + " must be UP, NEAREST, or DOWN");
+						return 1;
+					}
+					environ[unsigned(pseudoop)] = it->second;
+					continue;
+				}
+				if ( pseudoop != PseudoOps::EpxGpifFlgSel ) { // numeric values
+					value = strtoul(instr.stroperands[0].c_str(),&ep,pseudoop == PseudoOps::GpifIdleCtl ? 0 : 10);
+					bool fail = false;
+
+					if ( pseudoop == PseudoOps::GpifIdleCtl ) { // valid: 0..0xFF
+						fail = value > 0xFF;
+					} else if ( pseudoop != PseudoOps::WaveForm ) { // valid: 0/1 or 2/4/6/8
+						fail = value > ( pseudoop != PseudoOps::Ep ? 1 : 8 );
+
+						if ( !fail && pseudoop == PseudoOps::Ep && (value & 1) )
+							fail = true;		// Only EP 2, 4, 6 or 8
+					} else	fail = false;
+
+					if ( (ep && *ep) || fail ) {
+						report(diag,"Invalid operand '" + instr.stroperands[0] + "' for " + instr.stropcode);
+						return 1;
+					}
+				} else	{
+					auto it = flgsel.find(instr.stroperands[0]);
+					if ( it == flgsel.end() ) {
+						report(diag,"Operand of " + instr.stropcode + " must be PF, EF, or FF");
+						return 1;
+					}
+					value = it->second;		// EPxGPIFFLGSEL: 0, 1, 2
+				}
+				environ[unsigned(pseudoop)] = value;
+				continue;
+			} else	{
+				instrs.push_back(instr);
+			}
+		}
+	}
+
+	if ( (!instrs.empty() || !compiled) && close_section() )
+		rc = 1;
+	return rc;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Compile server, --serve reads requests from stdin and answers on
+// stdout, --serve=path accepts connections on a Unix socket. Each
+// connection may send any number of requests:
+//
+// Request:	u32 length, length bytes of waveform source
+// Response:	u32 length, then
+//		u8  exit code of the compile (0 == ok)
+//		u8  number of tables n (at most 255)
+//		n * { u32 waveform number, u8 ifconfig, u8 table[32] }
+//		u32 length, diagnostics (listing and errors as on stderr)
+//
+// All u32 are big endian, tables are in C array order. The exit code
+// is 1 if any error was reported. A request of length 0 or of more
+// than 16 MiB is answered with exit code 1 and a diagnostic, then the
+// connection is closed. Buffers are kept between requests.
+//
+// Connections to the socket are served one at a time. SIGINT, SIGTERM
+// and SIGHUP stop the server, which then removes its socket.
+//////////////////////////////////////////////////////////////////////
+
+static const uint32_t max_request = 16u << 20;
+
+static volatile sig_atomic_t stopping = 0;	// Signal received
+
+static void
+stop(int) {
+	stopping = 1;
+}
+
+static bool
+read_full(int fd,void *buf,size_t length) {
+	char *bp = (char *)buf;
+
+	while ( length > 0 ) {
+		ssize_t rc = read(fd,bp,length);
+		if ( rc < 0 && errno == EINTR && !stopping )
+			continue;
+		if ( rc <= 0 )
+			return false;
+		bp += rc;
+		length -= rc;
+	}
+	return true;
+}
+
+static bool
+write_full(int fd,const void *buf,size_t length) {
+	const char *bp = (const char *)buf;
+
+	while ( length > 0 ) {
+		ssize_t rc = write(fd,bp,length);
+		if ( rc < 0 && errno == EINTR && !stopping )
+			continue;
+		if ( rc <= 0 )
+			return false;
+		bp += rc;
+		length -= rc;
+	}
+	return true;
+}
+
+static void
+put32(std::string& buf,uint32_t u) {
+	buf += char(u >> 24);
+	buf += char(u >> 16);
+	buf += char(u >> 8);
+	buf += char(u);
+}
+
+// Send one response, returns false if the peer is gone
+static bool
+respond(int ofd,int rc,const std::vector<s_table>& tables,const std::string& text) {
+	static std::string response;
+
+	response.clear();
+	put32(response,0);			// Length, patched below
+	response += char(rc);
+	response += char(tables.size());
+	for ( auto& table : tables ) {
+		put32(response,table.waveformx);
+		response += char(table.ifconfig);
+		response.append((const char *)table.bytes,sizeof table.bytes);
+	}
+	put32(response,text.size());
+	response += text;
+
+	uint32_t total = response.size() - 4;
+	for ( unsigned ux=0; ux<4; ++ux )
+		response[ux] = char(total >> (24 - 8 * ux));
+	return write_full(ofd,response.data(),response.size());
+}
+
+// Serve one connection until EOF, a signal or a request ending it
+static void
+serve_fd(int ifd,int ofd) {
+	static std::string request;
+	static std::istringstream src;
+	static std::ostringstream diag;
+	static std::ostream null(nullptr);		// C code is not sent
+	static std::vector<s_instr> instrs;
+	static std::vector<s_table> tables;
+
+	for (;;) {
+		uint8_t hdr[4];
+
+		if ( !read_full(ifd,hdr,sizeof hdr) )
+			return;
+		uint32_t length = uint32_t(hdr[0]) << 24 | hdr[1] << 16 | hdr[2] << 8 | hdr[3];
+
+		diag.str("");
+		diag.clear();
+		tables.clear();
+		if ( length == 0 || length > max_request ) {
+			if ( length == 0 )
+				report(diag,"Empty request, closing the connection");
+			else	report(diag,"Request of " + std::to_string(length) + " bytes exceeds "
+					+ std::to_string(max_request >> 20) + " MiB, closing the connection");
+			respond(ofd,1,tables,diag.str());
+			return;
+		}
+		request.resize(length);
+		if ( !read_full(ifd,&request[0],length) )
+			return;
+
+		src.str(request);
+		src.clear();
+
+		int rc = compile(src,null,diag,instrs,tables);
+
+		if ( tables.size() > 255 ) {
+			report(diag,"More than 255 tables in one request");
+			tables.resize(255);
+			rc = 1;
+		}
+		if ( !respond(ofd,rc,tables,diag.str()) )
+			return;
+	}
+}
+
+static int
+serve(const char *path) {
+	struct sigaction sa;
+
+	signal(SIGPIPE,SIG_IGN);
+	memset(&sa,0,sizeof sa);
+	sa.sa_handler = stop;			// No SA_RESTART: interrupts accept() and read()
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT,&sa,nullptr);
+	sigaction(SIGTERM,&sa,nullptr);
+	sigaction(SIGHUP,&sa,nullptr);
+
+	if ( !path ) {
+		serve_fd(0,1);
+		return 0;
+	}
+
+	struct sockaddr_un addr;
+	struct stat st;
+	int sock;
+
+	if ( strlen(path) >= sizeof addr.sun_path ) {
+		std::cerr << "*** ERROR: Socket path too long: " << path << '\n';
+		return 1;
+	}
+	memset(&addr,0,sizeof addr);
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path,path);
+
+	if ( !stat(path,&st) && S_ISSOCK(st.st_mode) )
+		unlink(path);			// Stale socket of a former server
+
+	if ( (sock = socket(AF_UNIX,SOCK_STREAM,0)) < 0
+	  || bind(sock,(struct sockaddr *)&addr,sizeof addr) < 0
+	  || listen(sock,8) < 0 ) {
+		std::cerr << "*** ERROR: " << strerror(errno) << ": socket " << path << '\n';
+		return 1;
+	}
+
+	int rc = 0;
+
+	while ( !stopping ) {
+		int conn = accept(sock,nullptr,nullptr);
+
+		if ( conn < 0 ) {
+			if ( errno == EINTR )
+				continue;
+			std::cerr << "*** ERROR: " << strerror(errno) << ": accept " << path << '\n';
+			rc = 1;
+			break;
+		}
+		serve_fd(conn,conn);
+		close(conn);
+	}
+	close(sock);
+	unlink(path);
+	return rc;
+}
+
+int
+main(int argc,char **argv) {
+	std::vector<s_instr> instrs;
+	std::vector<s_table> tables;
+	std::vector<const char *> files;
+	const char *serve_path = nullptr;
+	bool serving = false, rate_table = false;
+	int rc = 0;
+
+	for ( int ax=1; ax < argc; ++ax ) {
+		if ( !strcmp(argv[ax],"--listing=json") )
+			listing_format = Listing::Json;
+		else if ( !strcmp(argv[ax],"--listing=text") )
+			listing_format = Listing::Text;
+		else if ( !strcmp(argv[ax],"--stats") )
+			stats = true;
+		else if ( !strcmp(argv[ax],"--rate-table") )
+			rate_table = true;
+		else if ( !strcmp(argv[ax],"--init") )
+			init_block = true;
+		else if ( !strcmp(argv[ax],"--serve") )
+			serving = true;
+		else if ( !strncmp(argv[ax],"--serve=",8) ) {
+			serving = true;
+			serve_path = argv[ax] + 8;
+		} else if ( argv[ax][0] != '-' ) {
+			files.push_back(argv[ax]);
+		} else	{
+			std::cerr << "Usage: " << argv[0] << " [--listing=text|json] [--stats] [--rate-table] [--init]\n"
+				<< "       [source.wvf...] <source.wvf >source.inc\n"
+				<< "       " << argv[0] << " [--listing=text|json] [--stats] --serve[=socket]\n"
+				<< "       (socket connections are served one at a time)\n";
+			exit(2);
+		}
+	}
+
+	if ( stats )
+		atexit(finish);
+	collect_tables = serving || rate_table;
+	if ( serving )
+		return serve(serve_path);
+	if ( files.empty() )
+		rc = compile(std::cin,std::cout,std::cerr,instrs,tables);
+	for ( auto path : files ) {
+		std::ifstream src(path);
+
+		if ( !src ) {
+			report(std::cerr,std::string(strerror(errno)) + ": opening " + path);
+			rc = 1;
+			continue;
+		}
+		if ( compile(src,std::cout,std::cerr,instrs,tables) )
+			rc = 1;
+	}
+	if ( rate_table && !rc )
+		rc = emit_rate_table(std::cout,std::cerr,tables);
+	return rc;
+}
+
 // End gpif_compiler.cpp
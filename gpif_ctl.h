@@ -0,0 +1,32 @@
+//////////////////////////////////////////////////////////////////////
+// gpif_ctl.h -- CTL and OE output operands by TRICTL
+///////////////////////////////////////////////////////////////////////
+//
+// Output operand names and their bit in the output byte. With TRICTL=0
+// CTL0..CTL5 are driven, with TRICTL=1 CTL0..CTL3 with the enables
+// OE0..OE3 (0: tri-state).
+
+static const std::map<unsigned,std::map<std::string,unsigned>> oetab = {
+	{ 0, {			// TRICTL=0
+		{ "CTL5", 5 },
+		{ "CTL4", 4 },
+		{ "CTL3", 3 },
+		{ "CTL2", 2 },
+		{ "CTL1", 1 },
+		{ "CTL0", 0 },
+	  }
+	},
+	{ 1, {			// TRICTL=1
+		{ "OE3",  7 },
+		{ "OE2",  6 },
+		{ "OE1",  5 },
+		{ "OE0",  4 },
+		{ "CTL3", 3 },
+		{ "CTL2", 2 },
+		{ "CTL1", 1 },
+		{ "CTL0", 0 },
+	  }
+	}
+};
+
+// End gpif_ctl.h
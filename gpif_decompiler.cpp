@@ -14,11 +14,16 @@
 //
 //    $ ./gpif_decompile gpif1.c [gpif2.c] ...
 //
+//    Only the first file is decompiled. --stats, given before it,
+//    reports time and heap allocations per phase to stderr.
+//
 // Note that the decompile doesn't figure out the environment
 // that it runs within. As a result, some values will show as
 // RDY5|TC or PF|EF|FF where it can't know. It may also get
 // the OEx CTLx wrong. If it sees OE3 or OE2, it will assume
 // from that point on that TRICTL is in effect.
+// gpif_import recovers the environment of GPIF Designer files
+// and emits source that compiles to the same tables.
 
 #include <stdio.h>
 #include <stdarg.h>
@@ -35,7 +40,21 @@
 #include <string>
 #include <sstream>
 #include "gpif.h"
-
+#include "gpif_stats.h"
+
+// --stats
+enum Phase {
+	PhaseScan,
+	PhaseDecode,
+};
+
+static bool stats = false;
+static std::vector<s_phase> phases = {
+	{ "scan",	0, 0, 0 },
+	{ "decode",	0, 0, 0 },
+};
+static unsigned long long ntables = 0;
+static unsigned long long ninstrs = 0;
 
 static void
 decompile(unsigned waveformx,uint8_t data[32]) {
@@ -45,6 +64,7 @@ decompile(unsigned waveformx,uint8_t data[32]) {
 	std::cout << "; WaveForm " << waveformx << '\n';
 
 	for ( ux=0; ux<32-4; ux += 4 ) {
+		++ninstrs;
 		u_branch branch;
 		u_opcode opcode;
 		u_logfunc logfunc;
@@ -56,61 +76,61 @@ decompile(unsigned waveformx,uint8_t data[32]) {
 		logfunc.byte = data[ux+2];
 		output.byte = data[ux+3];
 
-		if ( opcode.bits.dp == 1 )
+		if ( opcode.bits().dp == 1 )
 			opc << 'J';
-		if ( opcode.bits.sgl )
+		if ( opcode.bits().sgl )
 			opc << 'S';
-		if ( opcode.bits.incad )
+		if ( opcode.bits().incad )
 			opc << '+';
-		if ( opcode.bits.gint )
+		if ( opcode.bits().gint )
 			opc << 'G';
-		if ( opcode.bits.next )
+		if ( opcode.bits().next )
 			opc << 'N';
-		if ( opcode.bits.data )
+		if ( opcode.bits().data )
 			opc << 'D';
 		if ( !opcode.byte )
 			opc << 'Z';
-		if ( opcode.bits.dp && branch.bits.reexecute )
+		if ( opcode.bits().dp && branch.bits().reexecute )
 			opc << '*';
 
-		if ( output.bits1.oes3 || output.bits1.oes2 )
+		if ( output.bits1().oes3 || output.bits1().oes2 )
 			trictl = true;		// Assume TRICTL
 
 		auto outs = [&]() {
 			if ( trictl ) {
-				if ( output.bits1.oes3 )
+				if ( output.bits1().oes3 )
 					oper << " OES3";
-				if ( output.bits1.oes2 )
+				if ( output.bits1().oes2 )
 					oper << " OES2";
-				if ( output.bits1.oes1 )
+				if ( output.bits1().oes1 )
 					oper << " OES1";
-				if ( output.bits1.oes0 )
+				if ( output.bits1().oes0 )
 					oper << " OES0";
-				if ( output.bits1.ctl3 )
+				if ( output.bits1().ctl3 )
 					oper << " CTL3";
-				if ( output.bits1.ctl2 )
+				if ( output.bits1().ctl2 )
 					oper << " CTL2";
-				if ( output.bits1.ctl1 )
+				if ( output.bits1().ctl1 )
 					oper << " CTL1";
-				if ( output.bits1.ctl0 )
+				if ( output.bits1().ctl0 )
 					oper << " CTL0";
 			} else	{
-				if ( output.bits0.ctl5 )
+				if ( output.bits0().ctl5 )
 					oper << " CTL5";
-				if ( output.bits0.ctl4 )
+				if ( output.bits0().ctl4 )
 					oper << " CTL4";
-				if ( output.bits0.ctl3 )
+				if ( output.bits0().ctl3 )
 					oper << " CTL3";
-				if ( output.bits0.ctl2 )
+				if ( output.bits0().ctl2 )
 					oper << " CTL2";
-				if ( output.bits0.ctl1 )
+				if ( output.bits0().ctl1 )
 					oper << " CTL1";
-				if ( output.bits0.ctl0 )
+				if ( output.bits0().ctl0 )
 					oper << " CTL0";
 			}
 		};
 
-		if ( opcode.bits.dp == 0 ) {
+		if ( opcode.bits().dp == 0 ) {
 			// NDP
 
 			if ( branch.byte == 0 )
@@ -147,8 +167,8 @@ decompile(unsigned waveformx,uint8_t data[32]) {
 					break;
 				}
 			};
-			aorb(logfunc.bits.terma);
-			switch ( logfunc.bits.lfunc ) {
+			aorb(logfunc.bits().terma);
+			switch ( logfunc.bits().lfunc ) {
 			case 0b00:
 				oper << "AND ";
 				break;
@@ -162,10 +182,10 @@ decompile(unsigned waveformx,uint8_t data[32]) {
 				oper << "/AND ";
 				break;
 			}
-			aorb(logfunc.bits.termb);
+			aorb(logfunc.bits().termb);
 
-			oper << "$" << unsigned(branch.bits.branchon1)
-				<< " $" << unsigned(branch.bits.branchon0);
+			oper << "$" << unsigned(branch.bits().branchon1)
+				<< " $" << unsigned(branch.bits().branchon0);
 
 			outs();
 		}
@@ -187,8 +207,9 @@ decompile(unsigned waveformx,uint8_t data[32]) {
 	}
 }
 
-static void
-decompile(const char *path) {
+// Extract the bytes of WaveData[128] from a gpif.c file
+static std::vector<uint8_t>
+read_wavedata(const char *path) {
 	std::ifstream gpif_c;
 	char buf[2048];
 	bool foundf = false;
@@ -281,8 +302,20 @@ decompile(const char *path) {
 		}
 	}
 
-	std::cout << raw.size() << " bytes.\n";
 	gpif_c.close();
+	return raw;
+}
+
+static void
+decompile(const char *path) {
+	std::vector<uint8_t> raw;
+
+	{
+		s_phase_timer scan(phases[PhaseScan]);
+		raw = read_wavedata(path);
+	}
+
+	std::cout << raw.size() << " bytes.\n";
 
 	switch ( raw.size() ) {
 	case 32:
@@ -296,6 +329,7 @@ decompile(const char *path) {
 	}
 
 	uint8_t unpacked[32];
+	s_phase_timer decode(phases[PhaseDecode]);
 
 	memset(unpacked,0,sizeof unpacked);
 	for ( unsigned ux=0; ux < raw.size(); ux += 32 ) {
@@ -311,15 +345,27 @@ decompile(const char *path) {
 			unpacked[bx++] = raw[otx++];
 		}
 		decompile(ux/32,unpacked);
+		++ntables;
 	}
 
 	exit(0);
 }
 
+// Registered with atexit() by --stats, so every exit path reports
+static void
+finish() {
+	print_stats(phases,{ { "tables", ntables }, { "instructions", ninstrs } },false);
+}
+
 int main (int argc,char **argv) {
 
-	for ( int ax=1; ax < argc; ++ax )
-		decompile(argv[ax]);
+	for ( int ax=1; ax < argc; ++ax ) {
+		if ( !strcmp(argv[ax],"--stats") ) {
+			if ( !stats )
+				atexit(finish);
+			stats = true;
+		} else	decompile(argv[ax]);
+	}
 
 	return 0;
 }
@@ -0,0 +1,255 @@
+//////////////////////////////////////////////////////////////////////
+// gpif_equiv.cpp -- Cycle equivalence of two GPIF wave tables
+///////////////////////////////////////////////////////////////////////
+//
+// Explores the product state space of two wave tables under all
+// sequences of RDY / FIFO flag / INTRDY inputs and checks that both
+// produce the same CTL/OE outputs and the same DATA, NEXT, INCAD,
+// GINT and SGL actions in every IFCLK cycle, and go idle together.
+// If not, the shortest input trace leading to a difference is shown.
+//
+//    $ ./gpif_equiv [--trictl] [--idlectl=n] a.inc[:name] b.inc[:name]
+//
+// The tables are read from gpif_compiler output or from gpif.c files
+// (WaveData slots 0..3). With --trictl the CTLx level is ignored
+// while OEx tri-states it. With --idlectl=n (GPIFIDLECTL) B may go
+// idle before A while A only holds these levels without actions, as
+// gpif_import --optimize drops such states. Exit code 0: equivalent,
+// 1: different.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <deque>
+#include <unordered_map>
+#include <algorithm>
+#include "gpif.h"
+#include "gpif_sim.h"
+#include "gpif_table.h"
+
+
+static const char *termnames[8] = {
+	"RDY0", "RDY1", "RDY2", "RDY3", "RDY4", "RDY5/TC", "FIFO", "INTRDY"
+};
+
+static bool trictl = false;
+static int idlectl = -1;		// --idlectl: GPIFIDLECTL, -1: idle together
+
+struct s_observe {
+	bool			idle;
+	uint8_t			output;
+	uint8_t			actions;
+
+	bool operator==(const s_observe& o) const {
+		return idle == o.idle && output == o.output && actions == o.actions;
+	}
+};
+
+static uint8_t
+driven(uint8_t out) {
+	if ( trictl )			// Only driven levels count
+		out = (out & 0xF0) | (out & (out >> 4) & 0x0F);
+	return out;
+}
+
+static s_observe
+observe(const s_machine& m,const s_state states[8]) {
+	s_observe obs = { m.state >= 7, 0, machine_actions(m,states) };
+
+	if ( !obs.idle )
+		obs.output = driven(states[m.state].output.byte);
+	return obs;
+}
+
+// B idle while A holds the idle levels without actions (--idlectl)
+static bool
+earlier_idle(const s_observe& a,const s_observe& b) {
+	return idlectl >= 0 && b.idle && !a.idle && !a.actions && a.output == driven(idlectl);
+}
+
+static uint32_t
+pack(const s_machine& m) {
+	return m.state | (m.remain & 0x1FF) << 3 | uint32_t(m.fresh) << 12;
+}
+
+static s_machine
+unpack(uint32_t u) {
+	s_machine m = { u & 7, (u >> 3) & 0x1FF, bool((u >> 12) & 1) };
+	return m;
+}
+
+static std::string
+actions(uint8_t byte) {
+	u_opcode opcode;
+	std::string s;
+
+	opcode.byte = byte;
+	if ( opcode.bits().sgl )
+		s += 'S';
+	if ( opcode.bits().incad )
+		s += '+';
+	if ( opcode.bits().gint )
+		s += 'G';
+	if ( opcode.bits().data )
+		s += 'D';
+	if ( opcode.bits().next )
+		s += 'N';
+	return s.empty() ? "-" : s;
+}
+
+static std::string
+describe(const s_machine& m,const s_state states[8]) {
+	std::stringstream ss;
+	s_observe obs = observe(m,states);
+
+	if ( obs.idle )
+		return "$7 idle";
+	ss << '$' << m.state << ' ' << std::hex << std::uppercase << std::setw(2) << std::setfill('0')
+		<< unsigned(obs.output) << ' ' << actions(obs.actions);
+	return ss.str();
+}
+
+struct s_node {
+	uint32_t		parent;
+	uint8_t			inputs;
+};
+
+int
+main(int argc,char **argv) {
+	std::vector<std::string> specs;
+	s_wavetable tables[2];
+	s_state states[2][8];
+	std::string error;
+
+	for ( int ax=1; ax < argc; ++ax ) {
+		if ( !strcmp(argv[ax],"--trictl") )
+			trictl = true;
+		else if ( !strncmp(argv[ax],"--idlectl=",10) ) {
+			char *ep;
+
+			idlectl = strtoul(argv[ax]+10,&ep,0);
+			if ( *ep || !argv[ax][10] || idlectl > 0xFF ) {
+				std::cerr << "*** ERROR: invalid " << argv[ax] << ", must be 0..0xFF\n";
+				exit(2);
+			}
+		} else	specs.push_back(argv[ax]);
+	}
+	if ( specs.size() != 2 ) {
+		std::cerr << "Usage: " << argv[0] << " [--trictl] [--idlectl=n] a.inc[:name] b.inc[:name]\n";
+		exit(2);
+	}
+	for ( unsigned tx=0; tx<2; ++tx ) {
+		if ( !select_table(specs[tx],tables[tx],error) ) {
+			std::cerr << "*** ERROR: " << error << '\n';
+			exit(2);
+		}
+		table_states(tables[tx],states[tx]);
+	}
+
+	// Breadth first, so the first difference found has the shortest trace
+	std::unordered_map<uint32_t,s_node> seen;
+	std::deque<uint32_t> queue;
+	s_machine ma, mb;
+	uint32_t diverged = ~0u;
+
+	machine_reset(ma,states[0]);
+	machine_reset(mb,states[1]);
+	uint32_t root = pack(ma) << 13 | pack(mb);
+	seen[root] = s_node{ root, 0 };
+	queue.push_back(root);
+
+	while ( !queue.empty() ) {
+		uint32_t key = queue.front();
+		queue.pop_front();
+		s_machine a = unpack(key >> 13), b = unpack(key & 0x1FFF);
+
+		const s_observe oa = observe(a,states[0]), ob = observe(b,states[1]);
+
+		if ( !(oa == ob) && !earlier_idle(oa,ob) ) {
+			diverged = key;
+			break;
+		}
+
+		// Enumerate the combinations of the tested terms only
+		const unsigned terms = machine_terms(a,states[0]) | machine_terms(b,states[1]);
+		unsigned inputs = 0;
+
+		do	{
+			s_machine na = a, nb = b;
+
+			machine_step(na,states[0],inputs);
+			machine_step(nb,states[1],inputs);
+			uint32_t next = pack(na) << 13 | pack(nb);
+			if ( seen.find(next) == seen.end() ) {
+				seen[next] = s_node{ key, uint8_t(inputs) };
+				queue.push_back(next);
+			}
+			inputs = (inputs - terms) & terms;	// Next subset of terms
+		} while ( inputs );
+	}
+
+	if ( diverged == ~0u ) {
+		std::cout << "EQUIVALENT: " << specs[0] << " and " << specs[1]
+			<< " (" << seen.size() << " product states)\n";
+		return 0;
+	}
+
+	std::vector<uint32_t> trace;
+
+	for ( uint32_t key = diverged; ; key = seen[key].parent ) {
+		trace.push_back(key);
+		if ( key == root )
+			break;
+	}
+	std::reverse(trace.begin(),trace.end());
+
+	std::cout << "DIFFERENT: " << specs[0] << " and " << specs[1]
+		<< " diverge in cycle " << trace.size() - 1 << "\n\n"
+		<< "cycle  inputs (tested terms)          A                 B\n";
+
+	std::vector<std::string> rows;
+
+	for ( unsigned cx=0; cx<trace.size(); ++cx ) {
+		s_machine a = unpack(trace[cx] >> 13), b = unpack(trace[cx] & 0x1FFF);
+		std::stringstream in, row;
+
+		if ( cx + 1 < trace.size() ) {
+			const unsigned terms = machine_terms(a,states[0]) | machine_terms(b,states[1]);
+			const unsigned inputs = seen[trace[cx+1]].inputs;
+
+			for ( unsigned tx=0; tx<8; ++tx )
+				if ( terms & (1u << tx) )
+					in << termnames[tx] << '=' << ((inputs >> tx) & 1) << ' ';
+		}
+		row << std::left << std::setw(31) << in.str()
+			<< std::setw(18) << describe(a,states[0])
+			<< describe(b,states[1]);
+		rows.push_back(row.str());
+	}
+
+	// Runs of identical cycles are shown by their first and last cycle
+	bool skipping = false;
+
+	for ( unsigned cx=0; cx<rows.size(); ++cx ) {
+		if ( cx > 0 && cx + 1 < rows.size() && rows[cx] == rows[cx-1] && rows[cx] == rows[cx+1] ) {
+			if ( !skipping )
+				std::cout << "  ...\n";
+			skipping = true;
+			continue;
+		}
+		skipping = false;
+		std::cout << std::setw(5) << cx << "  " << rows[cx]
+			<< (cx + 1 == rows.size() ? "   <==" : "") << '\n';
+	}
+	return 1;
+}
+
+// End gpif_equiv.cpp
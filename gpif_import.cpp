@@ -0,0 +1,719 @@
+//////////////////////////////////////////////////////////////////////
+// gpif_import.cpp -- Import Cypress GPIF Designer gpif.c files
+///////////////////////////////////////////////////////////////////////
+//
+// Converts the WaveData of a GPIF Designer gpif.c into gpif_compiler
+// source, with the environment recovered from the InitData block,
+// the IFCONFIG assignment and the Designer comment headers (wave,
+// CTL and RDY names), and reports to stderr what the optimizer would
+// save per wave:
+//
+//    $ ./gpif_import [--optimize] [--all] [--flag=PF|EF|FF] gpif.c >gpif.wvf
+//
+// InitData is GPIFREADYCFG, GPIFCTLCFG, GPIFIDLECS, GPIFIDLECTL,
+// IFCONFIG, GPIFWFSELECT, GPIFREADYSTAT. They give .GPIFREADYCFG5/6/7,
+// .TRICTL, .IDLEDRV and .GPIFIDLECTL, IFCONFIG gives .IFCLKSRC,
+// .3048MHZ and .IFCLKOE. EPxGPIFFLGSEL is set by the firmware, the
+// FIFO flag term is named by --flag (default EF). Settings the source
+// cannot express (IFCLKPOL, sync mode, GSTATE, open drain CTLs) are
+// reported. Waves the header names "unused" are left out unless --all.
+//
+// The source has one line per state, up to the last reachable one,
+// so it compiles to the same table. The optimizer, applied with
+// --optimize, keeps the outputs and actions of every cycle:
+//	- drops unreachable states,
+//	- drops states without actions at the idle levels (GPIFIDLECTL)
+//	  that go to idle, the wave is done that much earlier,
+//	- merges an NDP state into the one before it when it is entered
+//	  only from there, has no actions and the same outputs.
+// A state left falling through to a dropped one becomes a DP jump.
+// Cycles are counted from state 0 to idle (or per loop), for each
+// constant input vector when the branches depend on the inputs.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <map>
+#include <algorithm>
+#include "gpif.h"
+#include "gpif_ctl.h"
+#include "gpif_sim.h"
+#include "gpif_table.h"
+
+
+static const unsigned idle = 7;
+static const char *roles[4] = { "FIFORD", "FIFOWR", "SINGLERD", "SINGLEWR" };
+
+// Recovered from the gpif.c file
+struct s_designer {
+	bool			initdata;	// InitData found
+	uint8_t			regs[7];	// InitData
+	int			ifconfig;	// IFCONFIG = .., -1: not found
+	std::map<std::string,std::string> waves;	// "0" -> FIFORd
+	std::map<unsigned,std::string> ctls;		// 0 -> SLRD
+	std::map<std::string,std::string> rdys;		// RDY0 -> FLAGC_EF
+	std::string		idledrive;	// Data Bus Idle Drive
+	std::string		intrdy;		// IntRdy=n
+	std::string		trictl;		// CTL Out Tristate-able ...
+};
+
+// A state of the import, branch and fall through targets explicit
+struct s_node {
+	s_state			state;
+	unsigned		interval;	// Designer interval (state) number
+	unsigned		next;		// NDP successor, idle: 7
+	bool			kept;
+};
+
+//////////////////////////////////////////////////////////////////////
+// Reading the gpif.c file
+//////////////////////////////////////////////////////////////////////
+
+static std::string
+trim(const std::string& s) {
+	size_t b = s.find_first_not_of(" \t\r"), e = s.find_last_not_of(" \t\r");
+
+	return b == std::string::npos ? "" : s.substr(b,e-b+1);
+}
+
+static bool
+read_designer(const std::string& path,s_designer& d,std::string& error) {
+	std::ifstream is(path);
+	std::stringstream ss;
+	std::string line;
+
+	d.initdata = false;
+	d.ifconfig = -1;
+	if ( !is ) {
+		error = std::string(strerror(errno)) + ": opening " + path;
+		return false;
+	}
+	ss << is.rdbuf();
+
+	// Designer headers: "// key = value" and "// key   value"
+	std::istringstream ls(ss.str());
+
+	while ( std::getline(ls,line) ) {
+		line = trim(line);
+		if ( line.compare(0,2,"//") )
+			continue;
+		line = trim(line.substr(2));
+
+		const size_t eq = line.find('=');
+		std::string key = eq == std::string::npos ? "" : trim(line.substr(0,eq));
+		std::istringstream vs(eq == std::string::npos ? "" : line.substr(eq+1));
+		std::string value, level;
+
+		vs >> value >> level;
+		if ( !key.compare(0,5,"Wave ") )
+			d.waves[trim(key.substr(5))] = value;
+		else if ( !key.compare(0,4,"CTL ") && value != "unused" )
+			d.ctls[strtoul(key.c_str()+4,nullptr,10)] = value;
+		else if ( !key.compare(0,3,"RDY") && key.size() == 4 && value != "unused" )
+			d.rdys[key] = value;
+		else if ( !line.compare(0,21,"Internal Ready Init  ") )
+			d.intrdy = trim(line.substr(21));
+		else if ( !line.compare(0,21,"Data Bus Idle Drive  ") )
+			d.idledrive = trim(line.substr(21));
+		else if ( !line.compare(0,22,"CTL Out Tristate-able ") )
+			d.trictl = trim(line.substr(22));
+	}
+
+	// InitData[7] and IFCONFIG = 0x..;
+	std::vector<std::string> tokens;
+
+	tokenize(ss.str(),tokens);
+	for ( size_t tx=0; tx<tokens.size(); ++tx ) {
+		if ( tokens[tx] == "IFCONFIG" && tx + 2 < tokens.size() && tokens[tx+1] == "="
+		  && isdigit((unsigned char)tokens[tx+2][0]) ) {
+			d.ifconfig = strtoul(tokens[tx+2].c_str(),nullptr,0) & 0xFF;
+			continue;
+		}
+		if ( tokens[tx] != "InitData" || d.initdata )
+			continue;
+
+		size_t vx = tx + 1;
+		unsigned n = 0;
+
+		while ( vx < tokens.size() && tokens[vx] != "{" && tokens[vx] != ";" )
+			++vx;
+		if ( vx >= tokens.size() || tokens[vx] != "{" )
+			continue;			// Use only
+		for ( ++vx; vx < tokens.size() && tokens[vx] != "}"; ++vx ) {
+			if ( tokens[vx] == "," )
+				continue;
+			char *ep;
+			unsigned long u = strtoul(tokens[vx].c_str(),&ep,0);
+
+			if ( *ep || u > 0xFF || n >= 7 ) {
+				error = path + ": invalid InitData";
+				return false;
+			}
+			d.regs[n++] = u;
+		}
+		if ( n != 7 ) {
+			error = path + ": InitData has " + std::to_string(n) + " bytes, expected 7";
+			return false;
+		}
+		d.initdata = true;
+	}
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+// States and the optimizer
+//////////////////////////////////////////////////////////////////////
+
+static uint8_t
+actions(const s_state& state) {
+	return state.opcode.byte & 0x3E;
+}
+
+// Deterministic successor, or -1 if the branch depends on the inputs
+static int
+successor(const s_node& node) {
+	if ( !node.state.opcode.bits().dp )
+		return node.next;
+	if ( node.state.branch.bits().branchon0 != node.state.branch.bits().branchon1 )
+		return -1;
+	return node.state.branch.bits().branchon1;
+}
+
+// Number of ways state sx is entered from other states
+static unsigned
+entries(const std::vector<s_node>& nodes,unsigned sx) {
+	unsigned n = sx == 0;			// Trigger
+
+	for ( unsigned ux=0; ux<nodes.size(); ++ux ) {
+		const s_node& node = nodes[ux];
+
+		if ( !node.kept || ux == sx )
+			continue;
+		if ( node.state.opcode.bits().dp )
+			n += (node.state.branch.bits().branchon0 == sx) + (node.state.branch.bits().branchon1 == sx);
+		else	n += node.next == sx;
+	}
+	return n;
+}
+
+static void
+redirect(std::vector<s_node>& nodes,unsigned from,unsigned to) {
+	for ( auto& node : nodes ) {
+		if ( !node.kept )
+			continue;
+		if ( node.state.opcode.bits().dp ) {
+			if ( node.state.branch.bits().branchon0 == from )
+				node.state.branch.bits().branchon0 = to;
+			if ( node.state.branch.bits().branchon1 == from )
+				node.state.branch.bits().branchon1 = to;
+		} else if ( node.next == from )
+			node.next = to;
+	}
+}
+
+static void
+reachable(std::vector<s_node>& nodes) {
+	std::vector<bool> seen(nodes.size(),false);
+	std::vector<unsigned> todo = { 0 };
+
+	while ( !todo.empty() ) {
+		const unsigned sx = todo.back();
+
+		todo.pop_back();
+		if ( sx >= nodes.size() || seen[sx] )
+			continue;
+		seen[sx] = true;
+
+		const s_state& state = nodes[sx].state;
+
+		if ( state.opcode.bits().dp ) {
+			todo.push_back(state.branch.bits().branchon0);
+			todo.push_back(state.branch.bits().branchon1);
+		} else	todo.push_back(nodes[sx].next);
+	}
+	for ( unsigned sx=0; sx<nodes.size(); ++sx )
+		nodes[sx].kept = nodes[sx].kept && seen[sx];
+}
+
+// Optimizer passes until none applies, notes what was done
+static void
+optimize(std::vector<s_node>& nodes,int idlectl,uint8_t outmask,std::vector<std::string>& notes) {
+	bool changed = true;
+
+	std::string unreached;
+
+	reachable(nodes);
+	for ( auto& node : nodes )
+		if ( !node.kept )
+			unreached += " " + std::to_string(node.interval);
+	if ( !unreached.empty() )
+		notes.push_back("interval" + unreached + ": unreachable, dropped");
+
+	while ( changed ) {
+		changed = false;
+
+		// Action free states at the idle levels going to idle
+		for ( unsigned sx=1; idlectl >= 0 && sx<nodes.size(); ++sx ) {
+			s_node& node = nodes[sx];
+
+			if ( !node.kept || actions(node.state) || successor(node) != int(idle)
+			  || (node.state.output.byte & outmask) != (idlectl & outmask) )
+				continue;
+			node.kept = false;
+			redirect(nodes,sx,idle);
+			notes.push_back("interval " + std::to_string(node.interval) + ": "
+				+ std::to_string(state_cycles(node.state)) + (state_cycles(node.state) == 1 ? " cycle" : " cycles")
+				+ " at the idle levels before idle, dropped");
+			changed = true;
+		}
+
+		// NDP continuing an NDP with the same outputs
+		for ( unsigned sx=0; sx<nodes.size(); ++sx ) {
+			s_node& node = nodes[sx];
+
+			if ( !node.kept || node.state.opcode.bits().dp || node.next >= nodes.size() )
+				continue;
+
+			s_node& next = nodes[node.next];
+
+			if ( !next.kept || next.state.opcode.bits().dp || actions(next.state)
+			  || next.state.output.byte != node.state.output.byte
+			  || entries(nodes,node.next) != 1
+			  || state_cycles(node.state) + state_cycles(next.state) > 256 )
+				continue;
+
+			const unsigned count = state_cycles(node.state) + state_cycles(next.state);
+
+			node.state.branch.byte = count == 256 ? 0 : count;
+			node.next = next.next;
+			next.kept = false;
+			notes.push_back("interval " + std::to_string(next.interval) + ": merged into interval "
+				+ std::to_string(node.interval));
+			changed = true;
+		}
+	}
+}
+
+// Kept states in order as a table, NDPs not falling through to their
+// successor become DP jumps (the last cycle of a longer NDP split off).
+// False if that needs more than 7 states.
+static bool
+layout(const std::vector<s_node>& nodes,std::vector<s_node>& out) {
+	std::vector<unsigned> position(nodes.size(),idle);
+	std::vector<bool> split(nodes.size(),false);
+	unsigned size = 0;
+
+	auto target = [&](unsigned sx) {
+		return sx >= nodes.size() ? idle : position[sx];
+	};
+
+	// Positions, until no more NDP needs its last cycle split off
+	for ( bool again=true; again; ) {
+		again = false;
+		size = 0;
+		for ( unsigned sx=0; sx<nodes.size(); ++sx ) {
+			if ( nodes[sx].kept ) {
+				position[sx] = size;
+				size += split[sx] ? 2 : 1;
+			}
+		}
+		for ( unsigned sx=0; sx<nodes.size(); ++sx ) {
+			const s_node& node = nodes[sx];
+
+			if ( node.kept && !node.state.opcode.bits().dp && !split[sx]
+			  && target(node.next) != position[sx] + 1 && state_cycles(node.state) > 1 )
+				split[sx] = again = true;
+		}
+	}
+	if ( size > 7 )
+		return false;
+
+	out.clear();
+	for ( unsigned sx=0; sx<nodes.size(); ++sx ) {
+		s_node node = nodes[sx];
+
+		if ( !node.kept )
+			continue;
+		if ( node.state.opcode.bits().dp ) {
+			node.state.branch.bits().branchon0 = target(node.state.branch.bits().branchon0);
+			node.state.branch.bits().branchon1 = target(node.state.branch.bits().branchon1);
+			out.push_back(node);
+			continue;
+		}
+
+		const unsigned to = target(node.next);
+
+		if ( to == position[sx] + 1 ) {		// Falls through (idle after 6)
+			out.push_back(node);
+			continue;
+		}
+
+		// Jump to the successor, in the last cycle of a longer NDP
+		s_node jump = node;
+
+		if ( split[sx] ) {
+			node.state.branch.byte = state_cycles(node.state) - 1;
+			out.push_back(node);
+			jump.state.opcode.byte = 0;
+		}
+		jump.state.opcode.bits().dp = 1;
+		jump.state.branch.byte = 0;
+		jump.state.branch.bits().branchon0 = jump.state.branch.bits().branchon1 = to;
+		jump.state.logfunc.byte = 0;
+		out.push_back(jump);
+	}
+	return true;
+}
+
+static void
+to_table(const std::vector<s_node>& nodes,s_state table[8]) {
+	for ( unsigned sx=0; sx<8; ++sx ) {
+		table[sx].branch.byte = table[sx].opcode.byte = 0;
+		table[sx].output.byte = table[sx].logfunc.byte = 0;
+		if ( sx < nodes.size() )
+			table[sx] = nodes[sx].state;
+	}
+}
+
+// Cycles from state 0 to idle (or per loop), for each constant input
+// vector if the branches depend on the inputs
+struct s_cycles {
+	unsigned		min, max;
+	bool			loop;		// Some inputs never reach idle
+	bool			inputs;		// Depends on the inputs
+};
+
+static s_cycles
+cycles(const s_state table[8]) {
+	const s_loop loop = find_loop(table);
+	s_cycles c = { loop.period, loop.period, !loop.idle, false };
+
+	if ( loop.deterministic )
+		return c;
+
+	c.min = ~0u;
+	c.max = 0;
+	c.inputs = true;
+	for ( unsigned inputs=0; inputs<256; ++inputs ) {
+		s_machine m;
+		unsigned n = 0;
+
+		machine_reset(m,table);
+		while ( m.state < idle && n <= 7 * 256 ) {
+			machine_step(m,table,inputs);
+			++n;
+		}
+		if ( m.state < idle ) {
+			c.loop = true;
+			continue;
+		}
+		c.min = std::min(c.min,n);
+		c.max = std::max(c.max,n);
+	}
+	if ( c.min > c.max )
+		c.min = c.max = 0;
+	return c;
+}
+
+static std::string
+cycles_text(const s_cycles& c) {
+	std::stringstream ss;
+
+	if ( c.min == c.max && !(c.inputs && c.max == 0) )
+		ss << c.min;
+	else if ( c.max )
+		ss << c.min << ".." << c.max;
+	else	ss << "no";
+	ss << " cycles " << (c.inputs || !c.loop ? "to idle" : "per loop");
+	if ( c.inputs && c.loop )
+		ss << ", waits for some inputs";
+	return ss.str();
+}
+
+//////////////////////////////////////////////////////////////////////
+// Source output
+//////////////////////////////////////////////////////////////////////
+
+static std::string
+term_name(unsigned term,unsigned cfg5,const std::string& flag) {
+	if ( term == 5 )
+		return cfg5 ? "TC" : "RDY5";
+	if ( term == 6 )
+		return flag;
+	if ( term == 7 )
+		return "INTRDY";
+	return "RDY" + std::to_string(term);
+}
+
+static std::string
+outputs(uint8_t byte,unsigned trictl) {
+	std::string s;
+
+	// CTL0 first, OEn after the CTLs
+	std::vector<std::pair<unsigned,std::string>> lines;
+
+	for ( auto& pair : oetab.at(trictl) )
+		lines.push_back({ pair.second, pair.first });
+	std::sort(lines.begin(),lines.end());
+	for ( auto& line : lines )
+		if ( byte & (1 << line.first) )
+			s += (s.empty() ? "" : " ") + line.second;
+	return s;
+}
+
+static void
+emit_wave(std::ostream& out,const std::string& name,const std::string& title,
+  const std::vector<s_node>& states,unsigned trictl,unsigned cfg5,const std::string& flag) {
+	out << "; Wave " << name << (title.empty() ? "" : ": " + title) << '\n'
+		<< "\t.WAVEFORM\t" << name << "\n\n";
+	for ( auto& node : states ) {
+		const s_state& st = node.state;
+		std::string opcode = st.opcode.bits().dp ? "J" : "";
+
+		if ( st.opcode.bits().sgl )
+			opcode += 'S';
+		if ( st.opcode.bits().incad )
+			opcode += '+';
+		if ( st.opcode.bits().gint )
+			opcode += 'G';
+		if ( st.opcode.bits().data )
+			opcode += 'D';
+		if ( st.opcode.bits().next )
+			opcode += 'N';
+		if ( st.opcode.bits().dp && st.branch.bits().reexecute )
+			opcode += '*';
+		if ( opcode.empty() )
+			opcode = "Z";
+
+		std::stringstream operands;
+		static const char *funcs[4] = { "AND", "OR", "XOR", "/AND" };
+
+		if ( st.opcode.bits().dp ) {
+			operands << term_name(st.logfunc.bits().terma,cfg5,flag) << ' ' << funcs[st.logfunc.bits().lfunc]
+				<< ' ' << term_name(st.logfunc.bits().termb,cfg5,flag)
+				<< " $" << unsigned(st.branch.bits().branchon1) << " $" << unsigned(st.branch.bits().branchon0);
+		} else	operands << state_cycles(st);
+		out << '\t' << opcode << '\t' << operands.str() << '\t' << outputs(st.output.byte,trictl)
+			<< "\t; interval " << node.interval << '\n';
+	}
+	out << '\n';
+}
+
+int
+main(int argc,char **argv) {
+	bool optimized = false, all = false;
+	std::string flag = "EF", path, error;
+
+	for ( int ax=1; ax < argc; ++ax ) {
+		if ( !strcmp(argv[ax],"--optimize") )
+			optimized = true;
+		else if ( !strcmp(argv[ax],"--all") )
+			all = true;
+		else if ( !strncmp(argv[ax],"--flag=",7) && (!strcmp(argv[ax]+7,"PF")
+		  || !strcmp(argv[ax]+7,"EF") || !strcmp(argv[ax]+7,"FF")) )
+			flag = argv[ax] + 7;
+		else if ( argv[ax][0] == '-' || !path.empty() ) {
+			path.clear();
+			break;
+		} else	path = argv[ax];
+	}
+	if ( path.empty() ) {
+		std::cerr << "Usage: " << argv[0] << " [--optimize] [--all] [--flag=PF|EF|FF] gpif.c\n";
+		exit(2);
+	}
+
+	std::vector<s_wavetable> tables;
+	s_designer d;
+
+	if ( !read_designer(path,d,error) || !read_tables(path,tables,error) ) {
+		std::cerr << "*** ERROR: " << error << '\n';
+		exit(1);
+	}
+
+	// Environment: InitData, else what the headers say
+	unsigned cfg7 = d.intrdy == "IntRdy=1", cfg6 = 0, cfg5 = d.rdys.count("RDY5") && d.rdys["RDY5"] == "TCXpire";
+	unsigned trictl = d.trictl == "Tristate", idledrv = d.idledrive == "Drive";
+	int idlectl = -1, wfselect = -1;
+	std::vector<std::string> lost;			// Not expressible in the source
+
+	if ( d.initdata ) {
+		cfg7 = d.regs[0] >> 7 & 1;
+		cfg6 = d.regs[0] >> 6 & 1;
+		cfg5 = d.regs[0] >> 5 & 1;
+		trictl = d.regs[1] >> 7 & 1;
+		idledrv = d.regs[2] >> 7 & 1;
+		idlectl = d.regs[3];
+		wfselect = d.regs[5];
+		if ( d.ifconfig < 0 )
+			d.ifconfig = d.regs[4];
+		if ( !trictl && (d.regs[1] & 0x3F) ) {
+			std::stringstream ss;
+
+			ss << "GPIFCTLCFG 0x" << std::hex << std::uppercase << std::setw(2) << std::setfill('0')
+				<< unsigned(d.regs[1]) << ": open drain CTL outputs";
+			lost.push_back(ss.str());
+		}
+	} else	lost.push_back("no InitData, the environment is taken from the headers");
+
+	unsigned ifclksrc = 1, mhz3048 = 0, ifclkoe = 0;
+
+	if ( d.ifconfig >= 0 ) {
+		std::stringstream ss;
+
+		ifclksrc = d.ifconfig >> 7 & 1;
+		mhz3048 = d.ifconfig >> 6 & 1;
+		ifclkoe = d.ifconfig >> 5 & 1;
+		ss << "IFCONFIG 0x" << std::hex << std::uppercase << std::setw(2) << std::setfill('0') << d.ifconfig << ':';
+		if ( d.ifconfig & 0x10 )
+			ss << " IFCLKPOL=1";
+		if ( !(d.ifconfig & 0x08) )
+			ss << " ASYNC=0";
+		if ( d.ifconfig & 0x04 )
+			ss << " GSTATE=1";
+		if ( (d.ifconfig & 0x03) != 0x02 )
+			ss << " IFCFG=" << (d.ifconfig & 0x03);
+		if ( (d.ifconfig & 0x1F) != 0x0A )
+			lost.push_back(ss.str() + " (the compiler sets ASYNC=1, GSTATE=0, IFCFG=2)");
+	}
+	if ( !ifclksrc )
+		lost.push_back("external IFCLK, add .IFCLKHZ for time counts");
+
+	const uint8_t outmask = trictl ? 0xFF : 0x3F;
+
+	// Source header and environment
+	std::cout << "; Imported from " << path << " (gpif_import" << (optimized ? " --optimize" : "") << ")\n";
+	if ( wfselect >= 0 ) {
+		std::cout << "; GPIFWFSELECT 0x" << std::hex << std::uppercase << std::setw(2) << std::setfill('0') << wfselect
+			<< std::dec << ':';
+		for ( unsigned rx=0; rx<4; ++rx )
+			std::cout << ' ' << roles[rx] << '=' << (wfselect >> 2 * rx & 3);
+		std::cout << '\n';
+	}
+	if ( !d.ctls.empty() ) {
+		std::cout << ';';
+		for ( auto& pair : d.ctls )
+			std::cout << " CTL" << pair.first << '=' << pair.second;
+		std::cout << '\n';
+	}
+	if ( !d.rdys.empty() ) {
+		std::cout << ';';
+		for ( auto& pair : d.rdys )
+			std::cout << ' ' << pair.first << '=' << pair.second;
+		std::cout << '\n';
+	}
+	for ( auto& text : lost )
+		std::cout << "; " << text << '\n';
+	std::cout << ";\n"
+		<< "\t.IFCLKSRC\t" << ifclksrc << '\n';
+	if ( ifclksrc )
+		std::cout << "\t.3048MHZ\t" << mhz3048 << '\n';
+	std::cout << "\t.IFCLKOE\t" << ifclkoe << '\n'
+		<< "\t.TRICTL\t\t" << trictl << '\n'
+		<< "\t.GPIFREADYCFG5\t" << cfg5 << '\n'
+		<< "\t.GPIFREADYCFG6\t" << cfg6 << '\n'
+		<< "\t.GPIFREADYCFG7\t" << cfg7 << '\n'
+		<< "\t.EPXGPIFFLGSEL\t" << flag << '\n';
+	if ( idlectl >= 0 )
+		std::cout << "\t.GPIFIDLECTL\t0x" << std::hex << std::uppercase << std::setw(2) << std::setfill('0')
+			<< idlectl << std::dec << '\n';
+	std::cout << "\t.IDLEDRV\t" << idledrv << "\n\n";
+
+	std::cerr << "; " << path << ": "
+		<< (d.initdata ? "environment from InitData" : "environment from the headers") << '\n';
+
+	int rc = 0;
+	unsigned waves = 0;
+
+	for ( auto& table : tables ) {
+		const std::string title = d.waves.count(table.name) ? d.waves[table.name] : "";
+
+		if ( !all && title == "unused" )
+			continue;
+
+		s_state original[8];
+		std::vector<s_node> nodes(7);
+
+		table_states(table,original);
+		for ( unsigned sx=0; sx<7; ++sx ) {
+			nodes[sx].state = original[sx];
+			nodes[sx].interval = sx;
+			nodes[sx].next = sx + 1;
+			nodes[sx].kept = true;
+		}
+
+		// Terms the compiler cannot name in this environment
+		for ( unsigned sx=0; sx<7; ++sx ) {
+			const s_state& st = original[sx];
+
+			if ( !st.opcode.bits().dp )
+				continue;
+			for ( unsigned term : { unsigned(st.logfunc.bits().terma), unsigned(st.logfunc.bits().termb) } ) {
+				if ( term == 7 && (!cfg7 || flag == "PF") ) {
+					std::cerr << "*** ERROR: wave " << table.name << " interval " << sx << ": INTRDY needs "
+						<< (cfg7 ? "--flag=EF or FF" : "GPIFREADYCFG.7") << '\n';
+					rc = 1;
+				}
+			}
+		}
+
+		// Faithful: every state up to the last reachable one
+		std::vector<s_node> faithful = nodes, optimal = nodes;
+		std::vector<std::string> notes;
+		unsigned last = 0;
+
+		reachable(faithful);
+		for ( unsigned sx=0; sx<7; ++sx )
+			if ( faithful[sx].kept )
+				last = sx;
+		faithful = nodes;
+		faithful.resize(last+1);
+
+		optimize(optimal,idlectl,outmask,notes);
+
+		std::vector<s_node> laid;
+		s_state before[8], after[8];
+
+		if ( !layout(optimal,laid) ) {
+			notes.push_back("needs more than 7 states, not optimized");
+			laid = faithful;
+		}
+		to_table(faithful,before);
+		to_table(laid,after);
+
+		const s_cycles cb = cycles(original), ca = cycles(after);
+		unsigned reached = 0;
+
+		reachable(nodes);
+		for ( auto& node : nodes )
+			reached += node.kept;
+
+		std::cerr << "; wave " << table.name << (title.empty() ? "" : " " + title) << ": "
+			<< reached << " states, " << cycles_text(cb) << "; optimized "
+			<< laid.size() << " states, " << cycles_text(ca);
+		if ( reached >= laid.size() && cb.max >= ca.max && !cb.loop == !ca.loop )
+			std::cerr << " (" << reached - laid.size() << " states, " << cb.max - ca.max << " cycles saved)";
+		std::cerr << '\n';
+		for ( auto& note : notes )
+			std::cerr << ";\t" << note << '\n';
+
+		emit_wave(std::cout,table.name,title,optimized ? laid : faithful,trictl,cfg5,flag);
+		++waves;
+	}
+	std::cout << "; End\n";
+	if ( !waves ) {
+		std::cerr << "*** ERROR: " << path << ": all waves unused, use --all\n";
+		rc = 1;
+	}
+	return rc;
+}
+
+// End gpif_import.cpp
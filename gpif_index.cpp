@@ -0,0 +1,601 @@
+//////////////////////////////////////////////////////////////////////
+// gpif_index.cpp -- Fingerprint index of the wave tables of a corpus
+///////////////////////////////////////////////////////////////////////
+//
+// Keeps an on-disk index from canonical wave tables to the places
+// using them, for finding every firmware with a given (slow, buggy)
+// waveform without rescanning the whole corpus:
+//
+//    $ ./gpif_index [--index=file] [--compiler=path] update path...
+//    $ ./gpif_index [--index=file] [--compiler=path] lookup file[:name]...
+//
+// update scans the files and directories (recursively) given: .wvf
+// sources are compiled with gpif_compiler (next to gpif_index unless
+// --compiler=path), .inc files and .c files with WaveData arrays
+// (GPIF Designer gpif.c) are read as they are. A file is rescanned
+// only if its mtime or size changed and then only parsed again if its
+// contents hash changed. Index entries of files gone from the scanned
+// paths are dropped, the others are kept.
+//
+// lookup reads the tables of the files given (all of them, or the one
+// named) and lists where the index has the same table and where the
+// same timing with a different CTL/OE mapping, with the mapping.
+//
+// Canonical table: states not reachable from state 0 are cleared, as
+// are the idle state 7, the reserved opcode and branch bits and the
+// logic function of NDP states. The timing key of a table is the
+// canonical table without the output bytes plus the sorted columns
+// of the output bits (the level of one CTL/OE line over states 0..6),
+// so it does not change when the lines are permuted.
+//
+// The index (default .gpif_index) is a text file:
+//
+//	F mtime size hash path			; one per file
+//	T table timing slot name ifconfig	; its tables, hex
+//
+// slot is the position of the table in the file, name selects it as
+// path:name for the other tools, ifconfig is -1 if unknown.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <map>
+#include <unordered_map>
+#include <algorithm>
+#include "gpif.h"
+#include "gpif_sim.h"
+#include "gpif_table.h"
+
+
+static std::string index_path = ".gpif_index";	// --index
+static std::string compiler;			// --compiler
+
+struct s_entry {
+	std::string		table;		// Canonical table, hex
+	std::string		timing;		// Timing key, hex
+	unsigned		slot;		// Position in the file
+	std::string		name;		// path:name selector
+	int			ifconfig;	// -1: unknown
+};
+
+struct s_file {
+	long long		mtime;
+	long long		size;
+	uint64_t		hash;		// FNV-1a of the contents
+	std::vector<s_entry>	entries;
+	bool			seen;		// Found by this update
+};
+
+typedef std::map<std::string,s_file> Index;
+
+static std::string
+hex(const uint8_t *bytes,unsigned n) {
+	static const char digits[] = "0123456789ABCDEF";
+	std::string s;
+
+	for ( unsigned ux=0; ux<n; ++ux ) {
+		s += digits[bytes[ux] >> 4];
+		s += digits[bytes[ux] & 15];
+	}
+	return s;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Canonical table and timing key
+//////////////////////////////////////////////////////////////////////
+
+static void
+canonical(const s_wavetable& table,uint8_t bytes[32]) {
+	s_state states[8];
+	bool reachable[8] = { false };
+	unsigned stack[8], depth = 0;
+
+	table_states(table,states);
+	stack[depth++] = 0;
+	while ( depth > 0 ) {
+		const unsigned sx = stack[--depth];
+
+		if ( sx >= 7 || reachable[sx] )
+			continue;
+		reachable[sx] = true;
+		if ( states[sx].opcode.bits().dp ) {
+			stack[depth++] = states[sx].branch.bits().branchon0;
+			stack[depth++] = states[sx].branch.bits().branchon1;
+		} else	stack[depth++] = sx + 1;
+	}
+
+	memset(bytes,0,32);
+	for ( unsigned sx=0; sx<7; ++sx ) {
+		s_state st = states[sx];
+
+		if ( !reachable[sx] )
+			continue;
+		st.opcode.bits().reserved = 0;
+		if ( st.opcode.bits().dp )
+			st.branch.bits().reserved = 0;
+		else	st.logfunc.byte = 0;
+		bytes[sx] = st.branch.byte;
+		bytes[sx+8] = st.opcode.byte;
+		bytes[sx+16] = st.output.byte;
+		bytes[sx+24] = st.logfunc.byte;
+	}
+}
+
+// Level of output bit b over states 0..6
+static uint8_t
+column(const uint8_t bytes[32],unsigned b) {
+	uint8_t col = 0;
+
+	for ( unsigned sx=0; sx<7; ++sx )
+		col |= ((bytes[sx+16] >> b) & 1) << sx;
+	return col;
+}
+
+static std::string
+timing_key(const uint8_t bytes[32]) {
+	uint8_t key[32], cols[8];
+
+	memcpy(key,bytes,32);
+	for ( unsigned b=0; b<8; ++b )
+		cols[b] = column(bytes,b);
+	std::sort(cols,cols+8);
+	memcpy(key+16,cols,8);
+	return hex(key,32);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Reading the tables of a file
+//////////////////////////////////////////////////////////////////////
+
+static bool
+ends_with(const std::string& s,const char *suffix) {
+	const size_t n = strlen(suffix);
+
+	return s.size() >= n && !s.compare(s.size()-n,n,suffix);
+}
+
+// gpif_compiler < path, its C code to text
+static bool
+compile(const std::string& path,std::string& text,std::string& error) {
+	int fds[2], in = open(path.c_str(),O_RDONLY);
+
+	if ( in < 0 ) {
+		error = std::string(strerror(errno)) + ": opening " + path;
+		return false;
+	}
+	if ( pipe(fds) < 0 ) {
+		error = std::string(strerror(errno)) + ": pipe";
+		close(in);
+		return false;
+	}
+
+	pid_t pid = fork();
+
+	if ( pid == 0 ) {
+		int null = open("/dev/null",O_WRONLY);
+
+		dup2(in,0);
+		dup2(fds[1],1);
+		if ( null >= 0 )
+			dup2(null,2);		// The listing
+		close(fds[0]);
+		execlp(compiler.c_str(),compiler.c_str(),(char *)nullptr);
+		_exit(127);
+	}
+	close(in);
+	close(fds[1]);
+	if ( pid < 0 ) {
+		error = std::string(strerror(errno)) + ": fork";
+		close(fds[0]);
+		return false;
+	}
+
+	char buf[4096];
+	ssize_t rc;
+	int status = 0;
+
+	text.clear();
+	while ( (rc = read(fds[0],buf,sizeof buf)) > 0 || (rc < 0 && errno == EINTR) )
+		if ( rc > 0 )
+			text.append(buf,rc);
+	close(fds[0]);
+	waitpid(pid,&status,0);
+	if ( WIFEXITED(status) && WEXITSTATUS(status) == 127 ) {
+		error = "cannot run " + compiler + " (use --compiler=path)";
+		return false;
+	}
+	return true;			// Sections with errors are left out
+}
+
+// The tables of path, false if it has none
+static bool
+file_tables(const std::string& path,const std::string& contents,std::vector<s_wavetable>& tables,std::string& error) {
+	std::string text = contents;
+
+	tables.clear();
+	if ( ends_with(path,".wvf") && !compile(path,text,error) )
+		return false;
+
+	std::istringstream is(text);
+	return read_tables(is,path,tables,error);
+}
+
+static bool
+read_file(const std::string& path,std::string& contents) {
+	std::ifstream is(path,std::ios::binary);
+	std::stringstream ss;
+
+	if ( !is )
+		return false;
+	ss << is.rdbuf();
+	contents = ss.str();
+	return true;
+}
+
+static uint64_t
+fnv1a(const std::string& data) {
+	uint64_t h = 0xCBF29CE484222325ull;
+
+	for ( unsigned char c : data ) {
+		h ^= c;
+		h *= 0x100000001B3ull;
+	}
+	return h;
+}
+
+static std::vector<s_entry>
+entries_of(const std::vector<s_wavetable>& tables) {
+	std::vector<s_entry> entries;
+
+	for ( unsigned tx=0; tx<tables.size(); ++tx ) {
+		uint8_t bytes[32];
+		s_entry e;
+
+		canonical(tables[tx],bytes);
+		e.table = hex(bytes,32);
+		e.timing = timing_key(bytes);
+		e.slot = tx;
+		e.name = tables[tx].name;
+		e.ifconfig = tables[tx].ifconfig;
+		entries.push_back(e);
+	}
+	return entries;
+}
+
+//////////////////////////////////////////////////////////////////////
+// The index file
+//////////////////////////////////////////////////////////////////////
+
+static bool
+load_index(Index& index,std::string& error) {
+	std::ifstream is(index_path);
+	std::string line;
+	s_file *file = nullptr;
+	unsigned lineno = 0;
+
+	if ( !is )
+		return true;			// A new index
+	while ( std::getline(is,line) ) {
+		std::istringstream ls(line);
+		std::string tag;
+
+		++lineno;
+		ls >> tag;
+		if ( tag == "F" ) {
+			std::string hash, path;
+			s_file f;
+
+			ls >> f.mtime >> f.size >> hash >> std::ws;
+			std::getline(ls,path);
+			f.hash = strtoull(hash.c_str(),nullptr,16);
+			f.seen = false;
+			if ( !ls.eof() || path.empty() )
+				break;
+			file = &(index[path] = f);
+		} else if ( tag == "T" && file ) {
+			s_entry e;
+
+			if ( !(ls >> e.table >> e.timing >> e.slot >> e.name >> e.ifconfig)
+			  || e.table.size() != 64 || e.timing.size() != 64 )
+				break;
+			file->entries.push_back(e);
+		} else if ( !tag.empty() && tag[0] != '#' )
+			break;
+		line.clear();
+	}
+	if ( !line.empty() ) {
+		error = index_path + ":" + std::to_string(lineno) + ": invalid index entry";
+		return false;
+	}
+	return true;
+}
+
+static bool
+save_index(const Index& index,std::string& error) {
+	const std::string tmp = index_path + ".tmp";
+	std::ofstream os(tmp);
+
+	os << "# gpif_index 1\n";
+	for ( auto& pair : index ) {
+		const s_file& f = pair.second;
+		char hash[20];
+
+		snprintf(hash,sizeof hash,"%016llX",(unsigned long long)f.hash);
+		os << "F " << f.mtime << ' ' << f.size << ' ' << hash << ' ' << pair.first << '\n';
+		for ( auto& e : f.entries )
+			os << "T " << e.table << ' ' << e.timing << ' ' << e.slot << ' '
+				<< e.name << ' ' << e.ifconfig << '\n';
+	}
+	os.close();
+	if ( !os || rename(tmp.c_str(),index_path.c_str()) < 0 ) {
+		error = std::string(strerror(errno)) + ": writing " + index_path;
+		unlink(tmp.c_str());
+		return false;
+	}
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+// update
+//////////////////////////////////////////////////////////////////////
+
+static std::vector<std::string> found;	// Files of the walk
+
+static int
+walk(const char *path,const struct stat *sb,int flag,struct FTW *) {
+	const std::string p = path;
+
+	(void)sb;
+	if ( flag == FTW_F && (ends_with(p,".wvf") || ends_with(p,".inc") || ends_with(p,".c")) )
+		found.push_back(p);
+	return 0;
+}
+
+static bool
+under(const std::string& path,const std::string& root) {
+	return path == root || (!path.compare(0,root.size(),root)
+		&& (root.back() == '/' || path[root.size()] == '/'));
+}
+
+static int
+update(Index& index,const std::vector<std::string>& roots) {
+	unsigned scanned = 0, parsed = 0, kept = 0, dropped = 0;
+	int rc = 0;
+
+	found.clear();
+	for ( auto& root : roots ) {
+		struct stat sb;
+
+		if ( stat(root.c_str(),&sb) < 0 ) {
+			std::cerr << "*** ERROR: " << strerror(errno) << ": " << root << '\n';
+			rc = 1;
+		} else if ( S_ISDIR(sb.st_mode) )
+			nftw(root.c_str(),walk,16,FTW_PHYS);
+		else	found.push_back(root);
+	}
+
+	for ( auto& path : found ) {
+		struct stat sb;
+		std::string contents, error;
+
+		if ( stat(path.c_str(),&sb) < 0 )
+			continue;
+
+		auto it = index.find(path);
+
+		++scanned;
+		if ( it != index.end() && it->second.mtime == sb.st_mtime && it->second.size == sb.st_size ) {
+			it->second.seen = true;
+			++kept;
+			continue;
+		}
+		if ( !read_file(path,contents) ) {
+			std::cerr << "*** ERROR: " << strerror(errno) << ": reading " << path << '\n';
+			rc = 1;
+			continue;
+		}
+
+		const uint64_t hash = fnv1a(contents);
+		s_file& f = index[path];
+
+		if ( it != index.end() && f.hash == hash ) {
+			++kept;			// Touched only
+		} else	{
+			std::vector<s_wavetable> tables;
+
+			++parsed;
+			if ( !file_tables(path,contents,tables,error) && !ends_with(path,".c") )
+				std::cerr << "; " << error << '\n';	// Not every .c is a gpif.c
+			f.entries = entries_of(tables);
+			f.hash = hash;
+		}
+		f.mtime = sb.st_mtime;
+		f.size = sb.st_size;
+		f.seen = true;
+	}
+
+	// Files gone from the scanned roots
+	for ( auto it = index.begin(); it != index.end(); ) {
+		bool gone = !it->second.seen;
+
+		if ( gone ) {
+			gone = false;
+			for ( auto& root : roots )
+				if ( under(it->first,root) )
+					gone = true;
+		}
+		if ( gone ) {
+			it = index.erase(it);
+			++dropped;
+		} else	++it;
+	}
+
+	size_t tables = 0;
+	for ( auto& pair : index )
+		tables += pair.second.entries.size();
+	std::cout << "; " << scanned << " files scanned, " << parsed << " parsed, " << kept << " unchanged, "
+		<< dropped << " dropped; index " << index.size() << " files, " << tables << " tables\n";
+	return rc;
+}
+
+//////////////////////////////////////////////////////////////////////
+// lookup
+//////////////////////////////////////////////////////////////////////
+
+// Output bit mapping from a to b with the same timing key, bits 4..7
+// are OE0..OE3 with TRICTL 1
+static std::string
+mapping(const std::string& a,const std::string& b) {
+	static const char *bits[8] = {
+		"CTL0", "CTL1", "CTL2", "CTL3", "CTL4/OE0", "CTL5/OE1", "OE2", "OE3"
+	};
+	uint8_t ba[32], bb[32];
+	bool used[8] = { false };
+	std::string s;
+
+	for ( unsigned ux=0; ux<32; ++ux ) {
+		ba[ux] = strtoul(a.substr(ux*2,2).c_str(),nullptr,16);
+		bb[ux] = strtoul(b.substr(ux*2,2).c_str(),nullptr,16);
+	}
+	for ( unsigned bit=0; bit<8; ++bit ) {
+		const uint8_t col = column(ba,bit);
+		unsigned to = bit;
+
+		if ( column(bb,bit) != col || used[bit] )
+			for ( to=0; to<8 && (used[to] || column(bb,to) != col); ++to )
+				;
+		if ( to >= 8 )
+			return "?";
+		used[to] = true;
+		if ( to != bit && col )		// Lines never driven high don't matter
+			s += std::string(" ") + bits[bit] + "=" + bits[to];
+	}
+	return s.empty() ? " (outputs equal)" : s;
+}
+
+static int
+lookup(const Index& index,const std::vector<std::string>& specs) {
+	std::unordered_multimap<std::string,std::pair<const std::string *,const s_entry *>> by_table, by_timing;
+	int rc = 0;
+
+	for ( auto& pair : index ) {
+		for ( auto& e : pair.second.entries ) {
+			by_table.insert({ e.table, { &pair.first, &e } });
+			by_timing.insert({ e.timing, { &pair.first, &e } });
+		}
+	}
+
+	for ( auto& spec : specs ) {
+		std::string path = spec, name, contents, error;
+		size_t colon = spec.rfind(':');
+		std::vector<s_wavetable> tables;
+
+		if ( colon != std::string::npos ) {
+			path = spec.substr(0,colon);
+			name = spec.substr(colon+1);
+		}
+		if ( !read_file(path,contents) ) {
+			std::cerr << "*** ERROR: " << strerror(errno) << ": opening " << path << '\n';
+			rc = 1;
+			continue;
+		}
+		if ( !file_tables(path,contents,tables,error) ) {
+			std::cerr << "*** ERROR: " << error << '\n';
+			rc = 1;
+			continue;
+		}
+
+		const std::vector<s_entry> entries = entries_of(tables);
+		bool any = false;
+
+		for ( auto& q : entries ) {
+			if ( !name.empty() && q.name != name )
+				continue;
+			any = true;
+			std::cout << "; " << path << ':' << q.name << '\n';
+
+			unsigned n = 0;
+			auto range = by_table.equal_range(q.table);
+			for ( auto it = range.first; it != range.second; ++it, ++n )
+				std::cout << "same\t" << *it->second.first << ':' << it->second.second->name
+					<< "\tslot " << it->second.second->slot << '\n';
+			range = by_timing.equal_range(q.timing);
+			for ( auto it = range.first; it != range.second; ++it ) {
+				if ( it->second.second->table == q.table )
+					continue;
+				std::cout << "timing\t" << *it->second.first << ':' << it->second.second->name
+					<< "\tslot " << it->second.second->slot
+					<< "\tmapping" << mapping(q.table,it->second.second->table) << '\n';
+				++n;
+			}
+			if ( !n )
+				std::cout << "; not in the index\n";
+		}
+		if ( !any ) {
+			std::cerr << "*** ERROR: " << path << ": no wave table " << name << '\n';
+			rc = 1;
+		}
+	}
+	return rc;
+}
+
+int
+main(int argc,char **argv) {
+	std::vector<std::string> args;
+	std::string error;
+	Index index;
+	int ax;
+
+	for ( ax=1; ax < argc && argv[ax][0] == '-'; ++ax ) {
+		if ( !strncmp(argv[ax],"--index=",8) )
+			index_path = argv[ax]+8;
+		else if ( !strncmp(argv[ax],"--compiler=",11) )
+			compiler = argv[ax]+11;
+		else	break;
+	}
+	for ( ; ax < argc; ++ax )
+		args.push_back(argv[ax]);
+	if ( args.size() < 2 || (args[0] != "update" && args[0] != "lookup") ) {
+		std::cerr << "Usage: " << argv[0] << " [--index=file] [--compiler=path] update path...\n"
+			<< "       " << argv[0] << " [--index=file] [--compiler=path] lookup file[:name]...\n";
+		exit(2);
+	}
+	if ( compiler.empty() ) {
+		const char *slash = strrchr(argv[0],'/');
+
+		compiler = slash ? std::string(argv[0],slash+1-argv[0]) + "gpif_compiler" : "gpif_compiler";
+	}
+	if ( !load_index(index,error) ) {
+		std::cerr << "*** ERROR: " << error << '\n';
+		exit(1);
+	}
+	const std::string command = args[0];
+
+	args.erase(args.begin());
+	if ( command == "update" ) {
+		int rc = update(index,args);
+
+		if ( !save_index(index,error) ) {
+			std::cerr << "*** ERROR: " << error << '\n';
+			rc = 1;
+		}
+		return rc;
+	}
+	return lookup(index,args);
+}
+
+// End gpif_index.cpp
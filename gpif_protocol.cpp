@@ -0,0 +1,467 @@
+//////////////////////////////////////////////////////////////////////
+// gpif_protocol.cpp -- Parallel bus waveforms from datasheet timings
+///////////////////////////////////////////////////////////////////////
+//
+// Generates the gpif_compiler source of one bus transaction from a
+// protocol template and the device timings in ns, each phase rounded
+// up to the fewest whole IFCLK cycles meeting all of its timings:
+//
+//    $ ./gpif_protocol [--ifclk=30M|48M|hz] [--trictl=0|1] [--loop]
+//		[--waveform=n] [--map=signal=CTLn|RDYn]... template [tXX=ns]...
+//    $ ./gpif_protocol --list
+//
+// TEMPLATES:
+//	sram-read sram-write		Asynchronous SRAM (CE# OE# WE#)
+//	i8080-read i8080-write		Intel 8080 bus (CS# RD# WR#)
+//	m6800-read m6800-write		Motorola 6800 bus (CS# E RW)
+//	ft245-read ft245-write		FT245 style FIFO (RD# WR, RXF# TXE#)
+//
+// A template is a sequence of phases with the signal levels, the
+// timings the phase must last at least (the longest counts) and the
+// timings spanning several phases (cycle time, setup to a later edge,
+// recovery across transactions), which stretch the last phase they
+// cover. Write data is driven (DATA) in all phases of a write, a read
+// samples it in the last cycle of its read phase. NEXT and INCAD come
+// in the last cycle of the transaction, the address and FIFO advance
+// after the hold times. A WAIT phase is a DP polling its RDY input.
+//
+// Signals get CTL0.. and inputs RDY0.. in template order, --map moves
+// them. The names are checked against oetab for the TRICTL setting
+// (with TRICTL 1 the used lines are driven by OE0..OE3). IFCLK 30M
+// and 48M use the internal clock, other values an external one. The
+// transaction ends in idle, with --loop it jumps back to $0.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <map>
+#include "gpif_ctl.h"
+
+
+static const unsigned max_states = 7;
+static const unsigned max_count = 256;
+
+enum class Data {
+	None,
+	Drive,				// Write data on the bus
+	Sample,				// Read in the last cycle
+};
+
+struct s_phase {
+	const char		*name;
+	const char		*levels;	// "signal=0|1 ..."
+	Data			data;
+	const char		*timings;	// Minimum duration, longest counts
+	const char		*wait;		// "input=0|1": DP polling, or 0
+};
+
+struct s_span {
+	const char		*timing;
+	unsigned		first, last;	// Phases, last < first wraps
+};					// into the next transaction
+
+struct s_template {
+	const char		*name;
+	const char		*title;
+	const char		*signals;
+	const char		*inputs;
+	std::vector<s_phase>	phases;
+	std::vector<s_span>	spans;
+};
+
+static const std::vector<s_template> templates = {
+	{ "sram-read", "asynchronous SRAM read", "CE# OE# WE#", "", {
+		{ "address",	"CE#=0 OE#=1 WE#=1", Data::None,	"tAS", 0 },
+		{ "read",	"CE#=0 OE#=0 WE#=1", Data::Sample,	"tOE", 0 },
+		{ "recovery",	"CE#=1 OE#=1 WE#=1", Data::None,	"tOHZ tAH", 0 },
+	  }, {
+		{ "tAA", 0, 1 }, { "tACE", 0, 1 }, { "tRC", 0, 2 },
+	  }
+	},
+	{ "sram-write", "asynchronous SRAM write", "CE# WE# OE#", "", {
+		{ "setup",	"CE#=0 WE#=1 OE#=1", Data::Drive,	"tAS", 0 },
+		{ "write",	"CE#=0 WE#=0 OE#=1", Data::Drive,	"tWP", 0 },
+		{ "hold",	"CE#=1 WE#=1 OE#=1", Data::Drive,	"tDH tAH tWR", 0 },
+	  }, {
+		{ "tDW", 0, 1 }, { "tCW", 0, 1 }, { "tAW", 0, 1 }, { "tWC", 0, 2 },
+	  }
+	},
+	{ "i8080-read", "Intel 8080 bus read", "CS# RD# WR#", "", {
+		{ "setup",	"CS#=0 RD#=1 WR#=1", Data::None,	"tAS", 0 },
+		{ "read",	"CS#=0 RD#=0 WR#=1", Data::Sample,	"tRDL tACC", 0 },
+		{ "hold",	"CS#=1 RD#=1 WR#=1", Data::None,	"tAH", 0 },
+	  }, {
+		{ "tCYC", 0, 2 }, { "tRDH", 2, 0 },
+	  }
+	},
+	{ "i8080-write", "Intel 8080 bus write", "CS# WR# RD#", "", {
+		{ "setup",	"CS#=0 WR#=1 RD#=1", Data::Drive,	"tAS", 0 },
+		{ "write",	"CS#=0 WR#=0 RD#=1", Data::Drive,	"tWRL", 0 },
+		{ "hold",	"CS#=1 WR#=1 RD#=1", Data::Drive,	"tAH tDH", 0 },
+	  }, {
+		{ "tDS", 0, 1 }, { "tCYC", 0, 2 }, { "tWRH", 2, 0 },
+	  }
+	},
+	{ "m6800-read", "Motorola 6800 bus read", "CS# E RW", "", {
+		{ "setup",	"CS#=0 E=0 RW=1", Data::None,		"tAS", 0 },
+		{ "enable",	"CS#=0 E=1 RW=1", Data::Sample,		"tPWEH tDDR", 0 },
+		{ "hold",	"CS#=1 E=0 RW=1", Data::None,		"tAH", 0 },
+	  }, {
+		{ "tCYC", 0, 2 }, { "tPWEL", 2, 0 },
+	  }
+	},
+	{ "m6800-write", "Motorola 6800 bus write", "CS# E RW", "", {
+		{ "setup",	"CS#=0 E=0 RW=0", Data::Drive,		"tAS", 0 },
+		{ "enable",	"CS#=0 E=1 RW=0", Data::Drive,		"tPWEH", 0 },
+		{ "hold",	"CS#=1 E=0 RW=0", Data::Drive,		"tAH tDHW", 0 },
+	  }, {
+		{ "tDSW", 0, 1 }, { "tCYC", 0, 2 }, { "tPWEL", 2, 0 },
+	  }
+	},
+	{ "ft245-read", "FT245 style FIFO read", "RD# WR", "RXF#", {
+		{ "wait",	"RD#=1 WR=0", Data::None,		"", "RXF#=0" },
+		{ "read",	"RD#=0 WR=0", Data::Sample,		"tRDL tACC", 0 },
+		{ "recovery",	"RD#=1 WR=0", Data::None,		"tRDH tRXF", 0 },
+	  }, {
+	  }
+	},
+	{ "ft245-write", "FT245 style FIFO write", "WR RD#", "TXE#", {
+		{ "wait",	"WR=0 RD#=1", Data::Drive,		"", "TXE#=0" },
+		{ "strobe",	"WR=1 RD#=1", Data::Drive,		"tWRH", 0 },
+		{ "hold",	"WR=0 RD#=1", Data::Drive,		"tDH tWRL tTXE", 0 },
+	  }, {
+		{ "tDS", 0, 1 },
+	  }
+	},
+};
+
+static std::vector<std::string>
+words(const char *text) {
+	std::istringstream is(text);
+	std::vector<std::string> out;
+	std::string word;
+
+	while ( is >> word )
+		out.push_back(word);
+	return out;
+}
+
+static std::string
+ns_text(double ns) {
+	std::ostringstream os;
+
+	os << std::fixed << std::setprecision(1) << ns << " ns";
+	return os.str();
+}
+
+// Phase of cycles, from a timing in ns: the fewest cycles lasting at least ns
+static unsigned
+cycles_for(double ns,double ifclk) {
+	const double exact = ns * ifclk / 1e9;
+	const unsigned n = unsigned(ceil(exact - 1e-9));
+
+	return n ? n : 1;
+}
+
+// One state of the output
+struct s_out {
+	unsigned		count;		// NDP cycles, 0: DP
+	bool			data, next, incad;
+	std::string		levels;		// CTL/OE operands
+	std::string		jump;		// DP: "term AND term $1 $2"
+	std::string		comment;
+};
+
+int
+main(int argc,char **argv) {
+	double ifclk = 48e6;
+	unsigned trictl = 0, waveformx = 0;
+	bool loop = false;
+	const s_template *tpl = nullptr;
+	std::map<std::string,double> timings;	// ns
+	std::map<std::string,std::string> mapping;
+
+	for ( int ax=1; ax < argc; ++ax ) {
+		const char *arg = argv[ax];
+
+		if ( !strncmp(arg,"--ifclk=",8) ) {
+			char *ep;
+
+			ifclk = strtod(arg+8,&ep);
+			if ( *ep == 'M' )
+				ifclk *= 1e6;
+			else if ( *ep == 'K' || *ep == 'k' )
+				ifclk *= 1e3;
+		} else if ( !strcmp(arg,"--trictl=0") || !strcmp(arg,"--trictl=1") )
+			trictl = arg[9] - '0';
+		else if ( !strcmp(arg,"--loop") )
+			loop = true;
+		else if ( !strncmp(arg,"--waveform=",11) )
+			waveformx = strtoul(arg+11,nullptr,10);
+		else if ( !strncmp(arg,"--map=",6) && strchr(arg+6,'=') ) {
+			const char *eq = strchr(arg+6,'=');
+
+			mapping[std::string(arg+6,eq-arg-6)] = eq + 1;
+		} else if ( !strcmp(arg,"--list") ) {
+			for ( auto& t : templates ) {
+				std::cout << std::left << std::setw(14) << t.name << t.title << ": " << t.signals;
+				if ( *t.inputs )
+					std::cout << ", input " << t.inputs;
+				std::cout << "\n\t\t";
+				for ( auto& phase : t.phases )
+					for ( auto& timing : words(phase.timings) )
+						std::cout << timing << ' ';
+				for ( auto& span : t.spans )
+					std::cout << span.timing << ' ';
+				std::cout << '\n';
+			}
+			return 0;
+		} else if ( arg[0] != '-' && strchr(arg,'=') && tpl ) {
+			const char *eq = strchr(arg,'=');
+			char *ep;
+			double ns = strtod(eq+1,&ep);
+
+			if ( *ep || ns < 0 ) {
+				std::cerr << "*** ERROR: Invalid timing '" << arg << "' (ns)\n";
+				exit(2);
+			}
+			timings[std::string(arg,eq-arg)] = ns;
+		} else if ( arg[0] != '-' && !tpl ) {
+			for ( auto& t : templates )
+				if ( !strcmp(t.name,arg) )
+					tpl = &t;
+			if ( !tpl ) {
+				std::cerr << "*** ERROR: Unknown template '" << arg << "', see --list\n";
+				exit(2);
+			}
+		} else	{
+			tpl = nullptr;
+			break;
+		}
+	}
+	if ( !tpl || ifclk <= 0 ) {
+		std::cerr << "Usage: " << argv[0] << " [--ifclk=30M|48M|hz] [--trictl=0|1] [--loop] [--waveform=n]\n"
+			<< "       [--map=signal=CTLn|RDYn]... template [tXX=ns]...\n"
+			<< "       " << argv[0] << " --list\n";
+		exit(2);
+	}
+
+	// Timings of the template, all others are typos
+	std::map<std::string,bool> known;
+
+	for ( auto& phase : tpl->phases )
+		for ( auto& timing : words(phase.timings) )
+			known[timing] = true;
+	for ( auto& span : tpl->spans )
+		known[span.timing] = true;
+	for ( auto& pair : timings ) {
+		if ( !known.count(pair.first) ) {
+			std::cerr << "*** ERROR: " << tpl->name << " has no timing " << pair.first << ", see --list\n";
+			exit(2);
+		}
+	}
+
+	// Signals to CTLn, inputs to RDYn
+	const auto& oemap = oetab.at(trictl);
+	std::map<std::string,unsigned> ctl, rdy;
+	unsigned next_ctl = 0, next_rdy = 0;
+
+	for ( auto& sig : words(tpl->signals) ) {
+		std::string name = mapping.count(sig) ? mapping[sig] : "CTL" + std::to_string(next_ctl++);
+		auto it = oemap.find(name);
+
+		if ( it == oemap.end() || name.compare(0,3,"CTL") ) {
+			std::cerr << "*** ERROR: " << sig << " on " << name << " is no output with .TRICTL " << trictl << '\n';
+			exit(1);
+		}
+		ctl[sig] = it->second;
+	}
+	for ( auto& sig : words(tpl->inputs) ) {
+		std::string name = mapping.count(sig) ? mapping[sig] : "RDY" + std::to_string(next_rdy++);
+
+		if ( name.size() != 4 || name.compare(0,3,"RDY") || name[3] < '0' || name[3] > '5' ) {
+			std::cerr << "*** ERROR: " << sig << " on " << name << " is no RDY0..RDY5 input\n";
+			exit(1);
+		}
+		rdy[sig] = name[3] - '0';
+	}
+	for ( auto& pair : mapping ) {
+		if ( !ctl.count(pair.first) && !rdy.count(pair.first) ) {
+			std::cerr << "*** ERROR: " << tpl->name << " has no signal " << pair.first << '\n';
+			exit(2);
+		}
+	}
+
+	// Cycles per phase: the longest of its own timings, then the spans
+	const size_t nphases = tpl->phases.size();
+	std::vector<unsigned> cycles(nphases);
+	std::vector<std::string> why(nphases);
+
+	for ( size_t px=0; px<nphases; ++px ) {
+		double ns = 0;
+
+		cycles[px] = 1;
+		for ( auto& timing : words(tpl->phases[px].timings) ) {
+			if ( timings.count(timing) && timings[timing] > ns ) {
+				ns = timings[timing];
+				why[px] = timing + " " + ns_text(ns);
+				cycles[px] = cycles_for(ns,ifclk);
+			}
+		}
+	}
+	for ( auto& span : tpl->spans ) {
+		if ( !timings.count(span.timing) )
+			continue;
+
+		const unsigned need = cycles_for(timings[span.timing],ifclk);
+		unsigned have = 0;
+
+		for ( size_t px=span.first; ; px = (px + 1) % nphases ) {
+			have += tpl->phases[px].wait ? 1 : cycles[px];
+			if ( px == span.last )
+				break;
+		}
+		if ( have < need && !tpl->phases[span.last].wait ) {
+			cycles[span.last] += need - have;
+			why[span.last] = std::string(span.timing) + " " + ns_text(timings[span.timing]);
+		}
+	}
+
+	// States: a phase is one NDP, the last cycle is split off when it
+	// samples, advances or ends the transaction (DP)
+	std::vector<s_out> states;
+
+	for ( size_t px=0; px<nphases; ++px ) {
+		const s_phase& phase = tpl->phases[px];
+		const bool final = px + 1 == nphases;
+		std::string levels;
+		uint8_t outputs = 0;
+
+		for ( auto& level : words(phase.levels) ) {
+			const size_t eq = level.find('=');
+
+			if ( level[eq+1] == '1' )
+				outputs |= 1 << ctl.at(level.substr(0,eq));
+		}
+		for ( unsigned bit=0; bit<8; ++bit ) {
+			if ( outputs & (1 << bit) )
+				levels += " CTL" + std::to_string(bit);
+		}
+		if ( trictl ) {
+			for ( auto& pair : ctl )
+				levels += " OE" + std::to_string(pair.second);
+		}
+
+		const double ns = cycles[px] * 1e9 / ifclk;
+		std::string comment = phase.name;
+
+		if ( phase.wait ) {
+			const std::string sig = words(phase.wait)[0];
+			const std::string input = sig.substr(0,sig.find('='));
+			const bool low = sig.back() == '0';
+			const std::string term = "RDY" + std::to_string(rdy.at(input));
+			s_out out = { 0, phase.data == Data::Drive, false, false, levels, "", "" };
+			const unsigned self = states.size(), next = self + 1;
+
+			// Then (term 1) / else (term 0) targets
+			out.jump = term + " AND " + term + " $" + std::to_string(low ? self : next)
+				+ " $" + std::to_string(low ? next : self);
+			out.comment = comment + ": until " + sig;
+			states.push_back(out);
+			continue;
+		}
+
+		comment += ": " + std::to_string(cycles[px]) + (cycles[px] == 1 ? " cycle" : " cycles")
+			+ " (" + ns_text(ns) + (why[px].empty() ? "" : ", " + why[px]) + ")";
+
+		const bool split = phase.data == Data::Sample || final;
+		s_out base = { cycles[px] - (split ? 1 : 0), phase.data == Data::Drive, false, false, levels, "", comment };
+
+		if ( base.count ) {
+			states.push_back(base);
+			comment = "";
+		}
+		if ( split ) {
+			s_out last = base;
+
+			last.count = final ? 0 : 1;
+			last.data = phase.data != Data::None;
+			last.incad = final;
+			last.comment = comment.empty() ? "(last cycle)" : comment;
+			if ( final ) {
+				last.jump = "RDY0 AND RDY0 $" + std::string(loop ? "0 $0" : "7 $7");
+				bool reads = false;
+
+				for ( auto& ph : tpl->phases )
+					reads |= ph.data == Data::Sample;
+				last.next = last.data && !reads;
+			}
+			states.push_back(last);
+		}
+	}
+
+	unsigned nstates = 0, total = 0;
+
+	for ( auto& state : states )
+		nstates += state.count ? (state.count + max_count - 1) / max_count : 1;
+	for ( size_t px=0; px<nphases; ++px )
+		total += tpl->phases[px].wait ? 1 : cycles[px];
+	if ( nstates > max_states ) {
+		std::cerr << "*** ERROR: " << tpl->name << " needs " << nstates << " states at "
+			<< ifclk / 1e6 << " MHz, more than " << max_states << '\n';
+		exit(1);
+	}
+
+	// gpif_compiler source
+	const bool internal = ifclk == 30e6 || ifclk == 48e6;
+
+	std::cout << "; " << tpl->title << " (gpif_protocol " << tpl->name << ")\n"
+		<< "; IFCLK " << ifclk / 1e6 << " MHz, " << ns_text(1e9 / ifclk) << " per cycle\n;";
+	for ( auto& sig : words(tpl->signals) )
+		std::cout << ' ' << sig << "=CTL" << ctl[sig];
+	for ( auto& sig : words(tpl->inputs) )
+		std::cout << ' ' << sig << "=RDY" << rdy[sig];
+	std::cout << "\n;";
+	for ( auto& pair : timings )
+		std::cout << ' ' << pair.first << '=' << pair.second;
+	std::cout << "\n; " << total << " cycles per transaction (" << ns_text(total * 1e9 / ifclk) << ")";
+	if ( *tpl->inputs )
+		std::cout << " when ready at once";
+	std::cout << ", " << std::fixed << std::setprecision(3) << ifclk / total / 1e6 << " MT/s\n"
+		<< std::defaultfloat << ";\n"
+		<< "\t.WAVEFORM\t" << waveformx << '\n'
+		<< "\t.TRICTL\t\t" << trictl << '\n'
+		<< "\t.IFCLKSRC\t" << internal << '\n';
+	if ( internal )
+		std::cout << "\t.3048MHZ\t" << (ifclk == 48e6) << '\n';
+	std::cout << '\n';
+
+	for ( auto& state : states ) {
+		std::string opcode = state.count ? "" : "J";
+
+		if ( state.incad )
+			opcode += '+';
+		if ( state.data )
+			opcode += 'D';
+		if ( state.next )
+			opcode += 'N';
+		if ( opcode.empty() )
+			opcode = "Z";
+		std::cout << '\t' << opcode << '\t'
+			<< (state.count ? std::to_string(state.count) : state.jump)
+			<< '\t' << state.levels.substr(state.levels.empty() ? 0 : 1)
+			<< "\t; " << state.comment << '\n';
+	}
+	std::cout << "\n; End\n";
+	return 0;
+}
+
+// End gpif_protocol.cpp
@@ -0,0 +1,481 @@
+//////////////////////////////////////////////////////////////////////
+// gpif_replay.cpp -- Replay a logic analyzer capture against a table
+///////////////////////////////////////////////////////////////////////
+//
+// Runs a compiled wave table cycle by cycle (gpif_sim.h) with the
+// RDY / FIFO flag / INTRDY inputs taken from a captured trace and
+// reports the DATA strobes achieved, the stall and idle cycles and
+// the throughput over the whole capture:
+//
+//    $ ./gpif_replay [--ifclk=hz] [--inputs=n] [--samplerate=hz]
+//		[--map=signal=term]... [--retrigger=n|--once] [--width=8|16]
+//		file.inc[:name] capture.vcd|capture.csv
+//
+// Captures are VCD files (value changes, $timescale) or sigrok CSV
+// exports (one row per sample, "; Samplerate:" comment or
+// --samplerate=hz; without a sample rate one row is one IFCLK
+// cycle). They are streamed, so the length is not limited by memory.
+//
+// Signals named RDY0..RDY5, TC, FIFO and INTRDY (any case) drive the
+// term of that name; --map=signal=term maps others, e.g. --map=D3=RDY1
+// or --map=bus[2]=FIFO for bit 2 of a VCD vector. Terms without a
+// signal keep their value from --inputs=n (default 0xFF).
+//
+// A cycle is a stall when a DP state waits for its condition (branches
+// to itself without actions), idle while the machine is in state 7.
+// After reaching idle the firmware retriggers the waveform after
+// --retrigger=n cycles (default 0: at once), with --once it stays idle.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <map>
+#include "gpif.h"
+#include "gpif_sim.h"
+#include "gpif_table.h"
+
+
+static const char *termnames[8] = {
+	"RDY0", "RDY1", "RDY2", "RDY3", "RDY4", "RDY5/TC", "FIFO", "INTRDY"
+};
+
+static double ifclk = 0;		// Hz, 0: unknown
+static double samplerate = 0;		// CSV rows/s, 0: one row per cycle
+static unsigned inputs = 0xFF;		// Terms without a signal
+static unsigned retrigger = 0;		// Idle cycles before retrigger
+static bool once = false;		// Do not retrigger
+static unsigned width = 8;		// Bus width, bits per strobe
+
+static std::map<std::string,unsigned> signal_map;	// Upper case name -> term
+
+//////////////////////////////////////////////////////////////////////
+// The machine, advanced cycle by cycle
+//////////////////////////////////////////////////////////////////////
+
+struct s_replay {
+	s_state			states[8];
+	s_machine		m;
+	unsigned		idle_left;	// Cycles until retrigger
+	uint64_t		cycles;
+	uint64_t		strobes;
+	uint64_t		stalls;
+	uint64_t		idles;
+	uint64_t		passes;		// Transitions to idle
+	unsigned		terms;		// Mapped terms seen in the capture
+};
+
+static void
+replay_step(s_replay& r,unsigned inputs) {
+	s_machine& m = r.m;
+
+	++r.cycles;
+	if ( m.state >= 7 ) {
+		++r.idles;
+		if ( !once && r.idle_left-- <= 1 )
+			machine_reset(m,r.states);
+		return;
+	}
+
+	const s_state& state = r.states[m.state];
+	const unsigned statex = m.state;
+	u_opcode actions;
+
+	actions.byte = machine_actions(m,r.states);
+	r.strobes += actions.bits().data;
+	machine_step(m,r.states,inputs);
+	if ( state.opcode.bits().dp && m.state == statex && !actions.byte )
+		++r.stalls;
+	if ( m.state >= 7 ) {
+		++r.passes;
+		r.idle_left = retrigger;
+		if ( !once && !retrigger )
+			machine_reset(m,r.states);
+	}
+}
+
+// Run all cycles sampling before time t (seconds)
+static void
+replay_until(s_replay& r,long double t,unsigned inputs) {
+	const uint64_t end = uint64_t(ceill(t * ifclk));
+
+	while ( r.cycles < end )
+		replay_step(r,inputs);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Signal names
+//////////////////////////////////////////////////////////////////////
+
+static std::string
+upper(std::string s) {
+	for ( auto& c : s )
+		c = toupper((unsigned char)c);
+	return s;
+}
+
+static int
+term_number(const std::string& name) {
+	const std::string u = upper(name);
+
+	for ( unsigned tx=0; tx<8; ++tx )
+		if ( u == termnames[tx] )
+			return tx;
+	if ( u == "RDY5" || u == "TC" )
+		return 5;
+	if ( u.size() == 1 && u[0] >= '0' && u[0] <= '7' )
+		return u[0] - '0';
+	return -1;
+}
+
+// Term driven by a capture signal, -1 if none
+static int
+signal_term(const std::string& name) {
+	auto it = signal_map.find(upper(name));
+
+	if ( it != signal_map.end() )
+		return it->second;
+	if ( isdigit((unsigned char)name[0]) )
+		return -1;			// Not a term number in a capture
+	return term_number(name);
+}
+
+//////////////////////////////////////////////////////////////////////
+// VCD: header, then #time and value changes
+//////////////////////////////////////////////////////////////////////
+
+struct s_bit {
+	unsigned		bit;		// Bit of the (vector) value
+	unsigned		term;
+};
+
+static bool
+timescale_seconds(const std::string& text,long double& scale) {
+	char *ep;
+	long double n = strtold(text.c_str(),&ep);
+	std::string unit(ep);
+
+	while ( !unit.empty() && isspace((unsigned char)unit[0]) )
+		unit.erase(0,1);
+	if ( unit == "s" )		scale = n;
+	else if ( unit == "ms" )	scale = n * 1e-3L;
+	else if ( unit == "us" )	scale = n * 1e-6L;
+	else if ( unit == "ns" )	scale = n * 1e-9L;
+	else if ( unit == "ps" )	scale = n * 1e-12L;
+	else if ( unit == "fs" )	scale = n * 1e-15L;
+	else	return false;
+	return n > 0;
+}
+
+static bool
+replay_vcd(std::istream& is,s_replay& r,std::string& error) {
+	std::map<std::string,std::vector<s_bit>> ids;
+	long double scale = 1e-9L;		// Seconds per time unit
+	std::string token;
+	unsigned values = inputs;
+
+	// Header up to $enddefinitions $end
+	while ( is >> token && token != "$enddefinitions" ) {
+		if ( token == "$timescale" ) {
+			std::string text, t;
+
+			while ( is >> t && t != "$end" )
+				text += t;
+			if ( !timescale_seconds(text,scale) ) {
+				error = "invalid $timescale '" + text + "'";
+				return false;
+			}
+		} else if ( token == "$var" ) {
+			std::string type, id, ref, range, t;
+			unsigned size = 1;
+
+			is >> type >> size >> id >> ref;
+			while ( is >> t && t != "$end" )
+				range += t;
+			if ( size == 1 ) {
+				int term = signal_term(ref);
+				if ( term < 0 && !range.empty() )
+					term = signal_term(ref + range);
+				if ( term >= 0 )
+					ids[id].push_back({ 0, unsigned(term) });
+			} else	{
+				unsigned lsb = 0;	// [msb:lsb]
+				size_t colon = range.find(':');
+				if ( colon != std::string::npos )
+					lsb = strtoul(range.c_str()+colon+1,nullptr,10);
+				for ( unsigned bx=0; bx<size; ++bx ) {
+					int term = signal_term(ref + "[" + std::to_string(lsb + bx) + "]");
+					if ( term >= 0 )
+						ids[id].push_back({ bx, unsigned(term) });
+				}
+			}
+		}
+	}
+	if ( !is ) {
+		error = "no $enddefinitions";
+		return false;
+	}
+	is >> token;				// $end
+	for ( auto& pair : ids )
+		for ( auto& b : pair.second )
+			r.terms |= 1u << b.term;
+
+	// Value changes
+	while ( is >> token ) {
+		const char c = token[0];
+		std::string id, value;
+
+		if ( c == '#' ) {
+			replay_until(r,strtold(token.c_str()+1,nullptr) * scale,values);
+			continue;
+		} else if ( c == '$' ) {		// $dumpvars, $end, ...
+			if ( token == "$comment" )
+				while ( is >> token && token != "$end" )
+					;
+			continue;
+		} else if ( c == 'b' || c == 'B' ) {
+			value = token.substr(1);
+			is >> id;
+		} else if ( c == 'r' || c == 'R' ) {
+			is >> id;
+			continue;
+		} else	{
+			value = token.substr(0,1);
+			id = token.substr(1);
+		}
+
+		auto it = ids.find(id);
+		if ( it == ids.end() )
+			continue;
+		for ( auto& b : it->second ) {
+			// Bit 0 is the last character, x and z read as 0
+			bool level = b.bit < value.size() && value[value.size()-1-b.bit] == '1';
+			values = level ? values | 1u << b.term : values & ~(1u << b.term);
+		}
+	}
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+// sigrok CSV: ; comments, a header row of names, one row per sample
+//////////////////////////////////////////////////////////////////////
+
+static bool
+replay_csv(std::istream& is,s_replay& r,std::string& error) {
+	std::vector<int> columns;		// Column -> term, -1: unused
+	std::string line;
+	unsigned values = inputs;
+	uint64_t row = 0;
+
+	while ( std::getline(is,line) ) {
+		if ( !line.empty() && line.back() == '\r' )
+			line.pop_back();
+		if ( line.empty() )
+			continue;
+		if ( line[0] == ';' ) {
+			size_t px = line.find("Samplerate:");
+			if ( px != std::string::npos && samplerate <= 0 ) {
+				char *ep;
+				double rate = strtod(line.c_str()+px+11,&ep);
+				while ( *ep == ' ' )
+					++ep;
+				if ( *ep == 'k' )	rate *= 1e3;
+				else if ( *ep == 'M' )	rate *= 1e6;
+				else if ( *ep == 'G' )	rate *= 1e9;
+				samplerate = rate;
+			}
+			continue;
+		}
+
+		std::vector<std::string> fields;
+		std::stringstream ss(line);
+		std::string field;
+
+		while ( std::getline(ss,field,',') ) {
+			while ( !field.empty() && isspace((unsigned char)field[0]) )
+				field.erase(0,1);
+			while ( !field.empty() && isspace((unsigned char)field.back()) )
+				field.pop_back();
+			fields.push_back(field);
+		}
+		if ( columns.empty() ) {		// Header row
+			for ( auto& name : fields ) {
+				int term = signal_term(name);
+				columns.push_back(term);
+				if ( term >= 0 )
+					r.terms |= 1u << term;
+			}
+			continue;
+		}
+		for ( size_t fx=0; fx<fields.size() && fx<columns.size(); ++fx ) {
+			if ( columns[fx] < 0 )
+				continue;
+			const unsigned bit = 1u << columns[fx];
+			values = fields[fx] == "1" ? values | bit : values & ~bit;
+		}
+		++row;
+		if ( samplerate > 0 )
+			replay_until(r,row / (long double)samplerate,values);
+		else	replay_step(r,values);
+	}
+	if ( columns.empty() ) {
+		error = "no CSV header";
+		return false;
+	}
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Report
+//////////////////////////////////////////////////////////////////////
+
+static std::string
+seconds(double s) {
+	std::stringstream ss;
+
+	ss << std::fixed << std::setprecision(1);
+	if ( s >= 1 )
+		ss << s << "s";
+	else if ( s >= 1e-3 )
+		ss << s * 1e3 << "ms";
+	else if ( s >= 1e-6 )
+		ss << s * 1e6 << "us";
+	else	ss << s * 1e9 << "ns";
+	return ss.str();
+}
+
+static std::string
+rate(double r) {
+	std::stringstream ss;
+
+	ss << std::fixed << std::setprecision(1);
+	if ( r >= 1e6 )
+		ss << r / 1e6 << "M";
+	else if ( r >= 1e3 )
+		ss << r / 1e3 << "k";
+	else	ss << r;
+	return ss.str();
+}
+
+static void
+report(const s_replay& r) {
+	const double t = r.cycles / ifclk;
+	const uint64_t active = r.cycles - r.idles;
+	const struct {
+		const char	*name;
+		uint64_t	count;
+	} rows[] = {
+		{ "active",	active - r.stalls },
+		{ "stall",	r.stalls },
+		{ "idle",	r.idles },
+	};
+
+	std::cout << "; Replayed " << r.cycles << " cycles (" << seconds(t) << "), terms from capture:";
+	for ( unsigned tx=0; tx<8; ++tx )
+		if ( r.terms & 1u << tx )
+			std::cout << ' ' << termnames[tx];
+	if ( !r.terms )
+		std::cout << " none";
+	std::cout << "\n;\n"
+		<< std::left << std::setw(14) << "cycles" << std::setw(14) << "count" << "share\n";
+	for ( auto& row : rows )
+		std::cout << std::setw(14) << row.name << std::setw(14) << row.count
+			<< std::fixed << std::setprecision(1)
+			<< (r.cycles ? 100.0 * row.count / r.cycles : 0.0) << "%\n";
+	std::cout << std::right << ";\n"
+		<< "; DATA strobes: " << r.strobes << ", " << rate(t > 0 ? r.strobes / t : 0) << "/s\n"
+		<< "; throughput: " << rate(t > 0 ? r.strobes * (width / 8) / t : 0) << "B/s ("
+		<< width << " bit bus)\n"
+		<< "; passes to idle: " << r.passes << '\n';
+}
+
+int
+main(int argc,char **argv) {
+	std::vector<std::string> files;
+	std::string error;
+	s_wavetable table;
+	s_replay r = {};
+	bool ok;
+
+	for ( int ax=1; ax < argc; ++ax ) {
+		if ( !strncmp(argv[ax],"--ifclk=",8) )
+			ifclk = strtod(argv[ax]+8,nullptr);
+		else if ( !strncmp(argv[ax],"--samplerate=",13) )
+			samplerate = strtod(argv[ax]+13,nullptr);
+		else if ( !strncmp(argv[ax],"--inputs=",9) )
+			inputs = strtoul(argv[ax]+9,nullptr,0) & 0xFF;
+		else if ( !strncmp(argv[ax],"--retrigger=",12) )
+			retrigger = strtoul(argv[ax]+12,nullptr,0);
+		else if ( !strcmp(argv[ax],"--once") )
+			once = true;
+		else if ( !strcmp(argv[ax],"--width=8") || !strcmp(argv[ax],"--width=16") )
+			width = atoi(argv[ax]+8);
+		else if ( !strncmp(argv[ax],"--map=",6) ) {
+			const char *eq = strchr(argv[ax]+6,'=');
+			int term = eq ? term_number(eq+1) : -1;
+			if ( term < 0 ) {
+				std::cerr << "*** ERROR: invalid " << argv[ax] << ", expected --map=signal=term\n";
+				exit(2);
+			}
+			signal_map[upper(std::string(argv[ax]+6,eq-argv[ax]-6))] = term;
+		} else if ( argv[ax][0] != '-' || !strcmp(argv[ax],"-") )
+			files.push_back(argv[ax]);
+		else	{
+			files.clear();
+			break;
+		}
+	}
+	if ( files.size() != 2 ) {
+		std::cerr << "Usage: " << argv[0] << " [--ifclk=hz] [--inputs=n] [--samplerate=hz] [--map=signal=term]...\n"
+			<< "       [--retrigger=n|--once] [--width=8|16] file.inc[:name] capture.vcd|capture.csv\n";
+		exit(2);
+	}
+	if ( !select_table(files[0],table,error) ) {
+		std::cerr << "*** ERROR: " << error << '\n';
+		exit(1);
+	}
+	table_states(table,r.states);
+	if ( ifclk <= 0 && table.ifconfig >= 0 && (table.ifconfig & 0x80) )
+		ifclk = table.ifconfig & 0x40 ? 48e6 : 30e6;
+	if ( ifclk <= 0 ) {
+		std::cerr << "*** ERROR: IFCLK unknown, use --ifclk=hz\n";
+		exit(1);
+	}
+	machine_reset(r.m,r.states);
+
+	const std::string& path = files[1];
+	const bool csv = path.size() > 4 && upper(path.substr(path.size()-4)) == ".CSV";
+	std::ifstream file;
+	std::istream *is = &std::cin;
+
+	if ( path != "-" ) {
+		file.open(path);
+		if ( !file ) {
+			std::cerr << "*** ERROR: " << strerror(errno) << ": opening " << path << '\n';
+			exit(1);
+		}
+		is = &file;
+	}
+
+	std::cout << "; Waveform " << table.name << " (" << table.file << "), IFCLK "
+		<< ifclk / 1e6 << " MHz, capture " << path << '\n';
+
+	ok = csv ? replay_csv(*is,r,error) : replay_vcd(*is,r,error);
+	if ( !ok ) {
+		std::cerr << "*** ERROR: " << path << ": " << error << '\n';
+		exit(1);
+	}
+	report(r);
+	return 0;
+}
+
+// End gpif_replay.cpp
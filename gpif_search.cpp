@@ -0,0 +1,694 @@
+//////////////////////////////////////////////////////////////////////
+// gpif_search.cpp -- Search waveforms meeting CTL pattern constraints
+///////////////////////////////////////////////////////////////////////
+//
+// Reads CTL pulse width, DATA strobe and RDY wait constraints and
+// enumerates looping programs of up to 7 states, returning the one
+// with the fewest IFCLK cycles per loop as gpif_compiler source:
+//
+//    $ ./gpif_search [--threads=n] [--states=n] constraints.txt >found.wvf
+//
+// CONSTRAINTS (UPPERCASE, ; comments):
+//
+//	LOW	CTLn	min [max]	; Every low pulse of CTLn: min..max cycles
+//	HIGH	CTLn	min [max]	; Every high pulse of CTLn
+//	DATA	[n]	[CTLn=0|1]...	; n DATA strobes per loop (default 1)
+//					; in states with these levels
+//	WAIT	term	[CTLn=0|1]...	; Wait for term (RDY0..RDY5, TC, PF,
+//					; EF, FF, INTRDY) with these levels
+//	.STATES	n			; At most n states (default 7)
+//	.PSEUDOOP ...			; Copied to the output (.TRICTL etc.)
+//
+// A line with a width constraint must toggle in every loop. The loop
+// ends with a DP jumping back to $0, WAITs are DPs branching to
+// themselves until their term is true (counted as ready at once, so
+// max widths hold for a peripheral that is always ready). CTL lines
+// not named are not driven (TRICTL=1) or low.
+//
+// The search is a depth first branch and bound over the states,
+// their CTL levels, DATA flags and counts. Counts are chosen tight:
+// 1 or the value completing the minimum width of a pulse, and are
+// shortened again where a later state completes the pulse. Subtrees
+// are spread over the threads by work stealing. Of programs with the
+// same cycles the one with fewer states is taken, then the first in
+// enumeration order, so the result does not depend on the threads.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+
+static const unsigned max_states = 7;
+static const unsigned max_count = 256;
+
+struct s_width {
+	unsigned		min;		// 0: unconstrained
+	unsigned		max;
+};
+
+struct s_cond {
+	unsigned		mask;		// Lines (bit per CTLn) tested
+	unsigned		levels;		// Required levels
+};
+
+struct s_wait {
+	std::string		term;
+	s_cond			cond;
+};
+
+struct s_spec {
+	unsigned		trictl = 0;
+	unsigned		nstates = max_states;
+	std::vector<std::string> pseudoops;	// Copied to the output
+	s_width			width[6][2];	// [CTLn][level]
+	unsigned		lines = 0;	// CTLn named anywhere
+	unsigned		toggling = 0;	// CTLn with a width constraint
+	unsigned		ndata = 0;
+	s_cond			data = { 0, 0 };
+	std::vector<s_wait>	waits;
+};
+
+static s_spec spec;
+
+//////////////////////////////////////////////////////////////////////
+// Programs
+//////////////////////////////////////////////////////////////////////
+
+enum Kind {
+	Ndp,				// count cycles, then next state
+	Wait,				// DP waiting for waits[wait]
+	Final,				// DP back to $0 (may wait too)
+};
+
+struct s_gstate {
+	uint8_t			levels;		// CTL levels, bit n == CTLn
+	uint8_t			data;
+	uint8_t			kind;
+	uint16_t		count;
+};
+
+struct s_prog {
+	unsigned		n;
+	s_gstate		st[max_states];
+};
+
+static unsigned
+prog_cycles(const s_prog& p) {
+	unsigned c = 0;
+
+	for ( unsigned sx=0; sx<p.n; ++sx )
+		c += p.st[sx].count;
+	return c;
+}
+
+// Enumeration order, for ties
+static bool
+prog_before(const s_prog& a,const s_prog& b) {
+	if ( a.n != b.n )
+		return a.n < b.n;
+	for ( unsigned sx=0; sx<a.n; ++sx ) {
+		const s_gstate& x = a.st[sx], & y = b.st[sx];
+
+		if ( x.levels != y.levels )
+			return x.levels < y.levels;
+		if ( x.data != y.data )
+			return x.data < y.data;
+		if ( x.kind != y.kind )
+			return x.kind < y.kind;
+		if ( x.count != y.count )
+			return x.count < y.count;
+	}
+	return false;
+}
+
+static bool
+cond_met(const s_cond& cond,unsigned levels) {
+	return (levels & cond.mask) == cond.levels;
+}
+
+// Length of the run of line l ending with state sx, and whether it
+// starts at state 0
+static unsigned
+run_before(const s_prog& p,unsigned sx,unsigned l,bool& head) {
+	const unsigned level = (p.st[sx].levels >> l) & 1;
+	unsigned len = 0;
+	int x = sx;
+
+	for ( ; x >= 0 && ((p.st[x].levels >> l) & 1) == level; --x )
+		len += p.st[x].count;
+	head = x < 0;
+	return len;
+}
+
+static bool
+width_ok(unsigned l,unsigned level,unsigned len) {
+	const s_width& w = spec.width[l][level];
+
+	return len >= w.min && (!w.max || len <= w.max);
+}
+
+// Check of a complete loop, including the pulses wrapping around
+static bool
+loop_ok(const s_prog& p) {
+	unsigned data = 0, waits = 0;
+
+	for ( unsigned sx=0; sx<p.n; ++sx ) {
+		data += p.st[sx].data;
+		waits += p.st[sx].kind == Wait;
+	}
+	if ( data != spec.ndata )
+		return false;
+	if ( waits + (spec.waits.empty() ? 0 : 1) != spec.waits.size() )
+		return false;
+
+	for ( unsigned l=0; l<6; ++l ) {
+		if ( !(spec.toggling & 1u << l) )
+			continue;
+
+		unsigned level[max_states], len[max_states], nruns = 0;
+
+		for ( unsigned sx=0; sx<p.n; ++sx ) {
+			const unsigned lv = p.st[sx].levels >> l & 1;
+
+			if ( !nruns || level[nruns-1] != lv ) {
+				level[nruns] = lv;
+				len[nruns++] = 0;
+			}
+			len[nruns-1] += p.st[sx].count;
+		}
+		if ( nruns < 2 )
+			return false;		// Does not toggle
+		if ( level[0] == level[nruns-1] )
+			len[0] += len[--nruns];
+		for ( unsigned rx=0; rx<nruns; ++rx )
+			if ( !width_ok(l,level[rx],len[rx]) )
+				return false;
+	}
+	return true;
+}
+
+// Shorten the NDP counts as far as the loop stays legal, for pulses
+// completed by later states (the closing DP, a wrap around)
+static void
+tighten(s_prog& p) {
+	for ( unsigned sx=0; sx<p.n; ++sx ) {
+		s_gstate& st = p.st[sx];
+
+		while ( st.kind == Ndp && st.count > 1 ) {
+			--st.count;
+			if ( !loop_ok(p) ) {
+				++st.count;
+				break;
+			}
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+// Branch and bound, shared by the workers
+//////////////////////////////////////////////////////////////////////
+
+static std::atomic<unsigned> best_cycles(~0u);
+static std::mutex best_lock;
+static s_prog best;
+static std::atomic<unsigned long long> nodes(0);
+
+static void
+offer(const s_prog& p) {
+	const unsigned c = prog_cycles(p);
+
+	if ( c > best_cycles.load() )
+		return;
+
+	std::lock_guard<std::mutex> guard(best_lock);
+
+	const unsigned b = best_cycles.load();
+
+	if ( c < b || (c == b && prog_before(p,best)) ) {
+		best = p;
+		best_cycles.store(c);
+	}
+}
+
+// Cycles still needed by the pending minimum widths (lower bound)
+static unsigned
+pending(const s_prog& p) {
+	unsigned need = 1;			// The closing DP
+
+	if ( p.st[p.n-1].kind == Final )
+		return 0;
+	for ( unsigned l=0; l<6; ++l ) {
+		if ( !(spec.toggling & 1u << l) )
+			continue;
+
+		const unsigned level = p.st[p.n-1].levels >> l & 1;
+		bool head;
+		unsigned len = run_before(p,p.n-1,l,head);
+		unsigned n = 0;
+
+		if ( head ) {			// Other level still to come
+			n = spec.width[l][level ^ 1].min;
+		} else if ( level == (p.st[0].levels >> l & 1) ) {
+			continue;		// Joins the first pulse
+		} else if ( len < spec.width[l][level].min )
+			n = spec.width[l][level].min - len;
+		if ( n > need )
+			need = n;
+	}
+	return need;
+}
+
+// The children of p: one more state
+static void
+expand(const s_prog& p,std::vector<s_prog>& children) {
+	const unsigned nwaits = spec.waits.size();
+	unsigned waits = 0, data = 0;
+
+	children.clear();
+	if ( p.n && p.st[p.n-1].kind == Final )
+		return;
+	if ( p.n >= spec.nstates )
+		return;
+	for ( unsigned sx=0; sx<p.n; ++sx ) {
+		waits += p.st[sx].kind == Wait;
+		data += p.st[sx].data;
+	}
+
+	const unsigned cycles = prog_cycles(p);
+
+	for ( unsigned levels=0; levels<64; ++levels ) {
+		if ( levels & ~spec.lines )
+			continue;
+
+		// Pulses ending with the previous state
+		if ( p.n ) {
+			bool ok = true;
+
+			for ( unsigned l=0; l<6 && ok; ++l ) {
+				if ( !(spec.toggling & 1u << l) || !((levels ^ p.st[p.n-1].levels) >> l & 1) )
+					continue;
+				bool head;
+				unsigned len = run_before(p,p.n-1,l,head);
+				if ( !head && !width_ok(l,p.st[p.n-1].levels >> l & 1,len) )
+					ok = false;
+			}
+			if ( !ok )
+				continue;
+		}
+
+		for ( unsigned kind=Ndp; kind<=Final; ++kind ) {
+			if ( kind == Wait && waits + 1 >= nwaits + (nwaits ? 0 : 1) )
+				continue;		// The last wait closes the loop
+			if ( kind == Final && waits + 1 < nwaits )
+				continue;
+			if ( kind != Ndp && nwaits && !cond_met(spec.waits[waits].cond,levels) )
+				continue;
+			if ( kind != Final && p.n + 1 >= spec.nstates )
+				continue;
+
+			for ( unsigned d=0; d<2; ++d ) {
+				if ( d && (data >= spec.ndata || !cond_met(spec.data,levels)) )
+					continue;
+
+				// Counts: 1 or completing a minimum width
+				unsigned counts[8], ncounts = 0;
+
+				counts[ncounts++] = 1;
+				for ( unsigned l=0; l<6 && kind == Ndp; ++l ) {
+					if ( !(spec.toggling & 1u << l) )
+						continue;
+					const unsigned level = levels >> l & 1;
+					unsigned len = 0;
+					if ( p.n && (p.st[p.n-1].levels >> l & 1) == level ) {
+						bool head;
+						len = run_before(p,p.n-1,l,head);
+					}
+					const unsigned min = spec.width[l][level].min;
+					if ( min > len + 1 && min - len <= max_count )
+						counts[ncounts++] = min - len;
+				}
+
+				for ( unsigned cx=0; cx<ncounts; ++cx ) {
+					const unsigned count = counts[cx];
+					bool dup = false, ok = true;
+
+					for ( unsigned x=0; x<cx; ++x )
+						dup = dup || counts[x] == count;
+					if ( dup )
+						continue;
+
+					// Same as merging into the previous NDP
+					if ( kind == Ndp && !d && p.n && p.st[p.n-1].kind == Ndp
+					  && p.st[p.n-1].levels == levels && p.st[p.n-1].count + count <= max_count )
+						continue;
+
+					s_prog c = p;
+					c.st[c.n++] = { uint8_t(levels), uint8_t(d), uint8_t(kind), uint16_t(count) };
+
+					// Maximum widths of the running pulses
+					for ( unsigned l=0; l<6 && ok; ++l ) {
+						if ( !(spec.toggling & 1u << l) )
+							continue;
+						bool head;
+						unsigned len = run_before(c,c.n-1,l,head);
+						const s_width& w = spec.width[l][levels >> l & 1];
+						if ( w.max && len > w.max )
+							ok = false;
+					}
+					if ( !ok || cycles + count + pending(c) > best_cycles.load() )
+						continue;
+					children.push_back(c);
+				}
+			}
+		}
+	}
+}
+
+static void
+search(const s_prog& p,std::vector<std::vector<s_prog>>& scratch) {
+	++nodes;
+	if ( p.n && p.st[p.n-1].kind == Final ) {
+		if ( loop_ok(p) ) {
+			s_prog t = p;
+
+			tighten(t);
+			offer(t);
+		}
+		return;
+	}
+
+	std::vector<s_prog>& children = scratch[p.n];
+
+	expand(p,children);
+	for ( size_t cx=0; cx<children.size(); ++cx )
+		search(scratch[p.n][cx],scratch);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Work stealing: each worker pops subtrees from the back of its own
+// deque and steals from the front of the others when it runs dry.
+// Subtrees above split_depth are split into their children.
+//////////////////////////////////////////////////////////////////////
+
+static const unsigned split_depth = 2;
+
+struct s_worker {
+	std::mutex		lock;
+	std::deque<s_prog>	tasks;
+};
+
+static std::vector<s_worker> workers;
+static std::atomic<unsigned long> outstanding(0);
+
+static bool
+take(unsigned wx,s_prog& task) {
+	{
+		std::lock_guard<std::mutex> guard(workers[wx].lock);
+
+		if ( !workers[wx].tasks.empty() ) {
+			task = workers[wx].tasks.back();
+			workers[wx].tasks.pop_back();
+			return true;
+		}
+	}
+	for ( unsigned ox=1; ox<workers.size(); ++ox ) {
+		s_worker& victim = workers[(wx + ox) % workers.size()];
+		std::lock_guard<std::mutex> guard(victim.lock);
+
+		if ( !victim.tasks.empty() ) {
+			task = victim.tasks.front();
+			victim.tasks.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+static void
+work(unsigned wx) {
+	std::vector<std::vector<s_prog>> scratch(max_states + 1);
+	std::vector<s_prog> children;
+	s_prog task;
+
+	while ( outstanding.load() ) {
+		if ( !take(wx,task) ) {
+			std::this_thread::yield();
+			continue;
+		}
+		if ( task.n < split_depth ) {
+			++nodes;
+			expand(task,children);
+			outstanding += children.size();
+			{
+				std::lock_guard<std::mutex> guard(workers[wx].lock);
+				for ( auto& c : children )
+					workers[wx].tasks.push_back(c);
+			}
+		} else	search(task,scratch);
+		--outstanding;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+// Constraints and output
+//////////////////////////////////////////////////////////////////////
+
+static int
+ctl_line(const std::string& name) {
+	char *ep;
+
+	if ( name.compare(0,3,"CTL") || name.size() != 4 )
+		return -1;
+	unsigned long l = strtoul(name.c_str()+3,&ep,10);
+	return *ep || l > 5 ? -1 : int(l);
+}
+
+static bool
+parse_cond(const std::vector<std::string>& tokens,size_t from,s_cond& cond,std::string& error) {
+	for ( size_t tx=from; tx<tokens.size(); ++tx ) {
+		const std::string& t = tokens[tx];
+		size_t eq = t.find('=');
+		int l = ctl_line(t.substr(0,eq));
+
+		if ( eq == std::string::npos || l < 0 || (t.substr(eq+1) != "0" && t.substr(eq+1) != "1") ) {
+			error = "invalid level '" + t + "', expected CTLn=0 or CTLn=1";
+			return false;
+		}
+		cond.mask |= 1u << l;
+		if ( t[eq+1] == '1' )
+			cond.levels |= 1u << l;
+		spec.lines |= 1u << l;
+	}
+	return true;
+}
+
+static bool
+read_spec(std::istream& is,std::string& error) {
+	static const char *terms[] = { "RDY0", "RDY1", "RDY2", "RDY3", "RDY4", "RDY5", "TC", "PF", "EF", "FF", "INTRDY" };
+	std::string line;
+	unsigned lineno = 0;
+
+	memset(spec.width,0,sizeof spec.width);
+	while ( std::getline(is,line) ) {
+		std::vector<std::string> tokens;
+		std::istringstream ls(line);
+		std::string t;
+
+		++lineno;
+		while ( ls >> t && t[0] != ';' )
+			tokens.push_back(t);
+		if ( tokens.empty() )
+			continue;
+
+		const std::string& op = tokens[0];
+		std::string err;
+
+		if ( op == ".STATES" ) {
+			spec.nstates = tokens.size() == 2 ? strtoul(tokens[1].c_str(),nullptr,10) : 0;
+			if ( spec.nstates < 1 || spec.nstates > max_states )
+				err = ".STATES must be 1..7";
+		} else if ( op[0] == '.' ) {
+			if ( op == ".TRICTL" && tokens.size() == 2 )
+				spec.trictl = tokens[1] == "1";
+			spec.pseudoops.push_back(line);
+		} else if ( op == "LOW" || op == "HIGH" ) {
+			int l = tokens.size() >= 3 ? ctl_line(tokens[1]) : -1;
+			s_width& w = spec.width[l < 0 ? 0 : l][op == "HIGH"];
+
+			if ( l < 0 || tokens.size() > 4 ) {
+				err = "expected " + op + " CTLn min [max]";
+			} else	{
+				w.min = strtoul(tokens[2].c_str(),nullptr,10);
+				w.max = tokens.size() == 4 ? strtoul(tokens[3].c_str(),nullptr,10) : 0;
+				if ( !w.min || (w.max && w.max < w.min) )
+					err = "invalid width";
+				spec.lines |= 1u << l;
+				spec.toggling |= 1u << l;
+			}
+		} else if ( op == "DATA" ) {
+			size_t from = 1;
+
+			spec.ndata = 1;
+			if ( tokens.size() > 1 && isdigit((unsigned char)tokens[1][0]) ) {
+				spec.ndata = strtoul(tokens[1].c_str(),nullptr,10);
+				from = 2;
+			}
+			if ( spec.ndata > max_states )
+				err = "at most 7 DATA strobes";
+			else	parse_cond(tokens,from,spec.data,err);
+		} else if ( op == "WAIT" ) {
+			s_wait wait = { tokens.size() > 1 ? tokens[1] : "", { 0, 0 } };
+			bool known = false;
+
+			for ( auto term : terms )
+				known = known || wait.term == term;
+			if ( !known )
+				err = "invalid WAIT term '" + wait.term + "'";
+			else if ( parse_cond(tokens,2,wait.cond,err) )
+				spec.waits.push_back(wait);
+		} else	err = "unknown constraint '" + op + "'";
+
+		if ( !err.empty() ) {
+			error = "line " + std::to_string(lineno) + ": " + err;
+			return false;
+		}
+	}
+	if ( spec.lines & ~(spec.trictl ? 0x0Fu : 0x3Fu) ) {
+		error = spec.trictl ? "only CTL0..CTL3 with .TRICTL 1" : "only CTL0..CTL5";
+		return false;
+	}
+	if ( spec.waits.size() > max_states ) {
+		error = "too many WAITs";
+		return false;
+	}
+	return true;
+}
+
+static std::string
+outputs(unsigned levels) {
+	std::string s;
+
+	for ( unsigned l=0; l<6; ++l ) {
+		if ( !(spec.lines & 1u << l) )
+			continue;
+		if ( levels & 1u << l )
+			s += " CTL" + std::to_string(l);
+		if ( spec.trictl )
+			s += " OE" + std::to_string(l);
+	}
+	return s;
+}
+
+static void
+print(std::ostream& out,const s_prog& p) {
+	unsigned waits = 0;
+
+	out << "; gpif_search: " << prog_cycles(p) << " cycles per loop, " << p.n << " states\n";
+	for ( auto& line : spec.pseudoops )
+		out << line << '\n';
+
+	for ( unsigned sx=0; sx<p.n; ++sx ) {
+		const s_gstate& st = p.st[sx];
+		std::string op = st.data ? "D" : "Z";
+		std::stringstream levels;
+
+		for ( unsigned l=0; l<6; ++l )
+			if ( spec.lines & 1u << l )
+				levels << " CTL" << l << '=' << (st.levels >> l & 1);
+
+		out << '\t';
+		if ( st.kind == Ndp ) {
+			out << op << '\t' << st.count;
+		} else	{
+			const std::string term = spec.waits.empty() ? "RDY0" : spec.waits[waits++].term;
+			const unsigned self = st.kind == Wait || !spec.waits.empty() ? sx : 0;
+
+			out << 'J' << (st.data ? "D" : "") << '\t' << term << " AND " << term
+				<< " $" << (st.kind == Final ? 0 : sx + 1) << " $" << self;
+		}
+		out << outputs(st.levels) << "\t;" << levels.str() << '\n';
+	}
+}
+
+int
+main(int argc,char **argv) {
+	unsigned nthreads = std::thread::hardware_concurrency();
+	const char *path = nullptr;
+	std::string error;
+
+	for ( int ax=1; ax < argc; ++ax ) {
+		if ( !strncmp(argv[ax],"--threads=",10) )
+			nthreads = strtoul(argv[ax]+10,nullptr,10);
+		else if ( !strncmp(argv[ax],"--states=",9) )
+			spec.nstates = strtoul(argv[ax]+9,nullptr,10);
+		else if ( argv[ax][0] != '-' && !path )
+			path = argv[ax];
+		else	{
+			path = nullptr;
+			break;
+		}
+	}
+	if ( !path ) {
+		std::cerr << "Usage: " << argv[0] << " [--threads=n] [--states=n] constraints.txt\n";
+		exit(2);
+	}
+
+	const unsigned states_option = spec.nstates;
+	std::ifstream is(path);
+
+	if ( !is ) {
+		std::cerr << "*** ERROR: " << strerror(errno) << ": opening " << path << '\n';
+		exit(1);
+	}
+	if ( !read_spec(is,error) ) {
+		std::cerr << "*** ERROR: " << path << ": " << error << '\n';
+		exit(1);
+	}
+	if ( states_option < spec.nstates )
+		spec.nstates = states_option;
+	if ( spec.nstates < 1 || spec.nstates > max_states ) {
+		std::cerr << "*** ERROR: --states must be 1..7\n";
+		exit(2);
+	}
+	if ( nthreads < 1 )
+		nthreads = 1;
+
+	const auto t0 = std::chrono::steady_clock::now();
+	std::vector<std::thread> threads;
+	s_prog root = {};
+
+	workers = std::vector<s_worker>(nthreads);
+	workers[0].tasks.push_back(root);
+	outstanding = 1;
+	for ( unsigned tx=0; tx<nthreads; ++tx )
+		threads.emplace_back(work,tx);
+	for ( auto& t : threads )
+		t.join();
+
+	const double ms = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+	std::cerr << "; " << nodes.load() << " nodes, " << nthreads << " threads, "
+		<< std::fixed << std::setprecision(1) << ms << " ms\n";
+	if ( best_cycles.load() == ~0u ) {
+		std::cerr << "*** ERROR: no program of up to " << spec.nstates << " states meets the constraints\n";
+		return 1;
+	}
+	print(std::cout,best);
+	return 0;
+}
+
+// End gpif_search.cpp
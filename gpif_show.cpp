@@ -1,5 +1,33 @@
+//////////////////////////////////////////////////////////////////////
+// gpif_show.cpp -- Show the structure and timing of GPIF wave tables
+///////////////////////////////////////////////////////////////////////
+//
+//    $ ./gpif_show < file.inc
+//    $ ./gpif_show [--svg|--html] [--ifclk=hz] [--inputs=n] [--trictl=0|1] file...
+//
+// Without arguments the wave table on stdin is shown as a table like
+// the TRM (fig. 10-12). Files are .inc / gpif.c sources, all their
+// waveform_n and WaveData slots are shown, or binary images of 32 to
+// 128 bytes (1..4 slots). --svg and --html draw timing diagrams
+// instead: the path from state 0 with the given inputs (default 0xFF)
+// until it loops or goes idle, each state as wide as its cycles, with
+// CTL levels (OE from .TRICTL 1 unless --trictl=0), DATA / NEXT /
+// GINT strobes, the loop period and the sample rate.
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <map>
+#include "gpif.h"
+#include "gpif_sim.h"
+#include "gpif_table.h"
 
 
 static unsigned char* get_waveform( FILE *infile) {
@@ -31,8 +59,7 @@ static unsigned char* get_waveform( FILE *infile) {
 
 
 
-int main() {
-
+static void show_ascii( const unsigned char *waveform ) {
 
 	char term[][8] = {
 		"  RDY0 ",
@@ -53,10 +80,17 @@ int main() {
 	};
 
 
-	unsigned char *len_br = get_waveform( stdin );
-	unsigned char *opcode = len_br + 8;
-	unsigned char *output = len_br + 16;
-	unsigned char *logic  = len_br + 24;
+	u_branch len_br[ 7 ];
+	u_opcode opcode[ 7 ];
+	u_output output[ 7 ];
+	u_logfunc logic[ 7 ];
+
+	for ( int state = 0; state < 7; ++state ) {
+		len_br[ state ].byte = waveform[ state ];
+		opcode[ state ].byte = waveform[ state + 8 ];
+		output[ state ].byte = waveform[ state + 16 ];
+		logic[ state ].byte = waveform[ state + 24 ];
+	}
 
 	printf(   "                  " );
 	for ( int state = 0; state < 7; ++state )
@@ -66,27 +100,27 @@ int main() {
 		printf( " ---------" );
 	printf( "\nInc Addr:      " ); // INCAD
 	for ( int state = 0; state < 7; ++state ) {
-		if ( opcode[ state ] & 0b00001000 )
+		if ( opcode[ state ].bits().incad )
 			printf( "       ++ " );
 		else
 			printf( "          " );
 	}
 	printf( "\nDataMode:      " ); // DATA
 	for ( int state = 0; state < 7; ++state ) {
-		if ( opcode[ state ] & 0b00000010 )
+		if ( opcode[ state ].bits().data )
 			printf( "      DATA" );
 		else
 			printf( "          " );
 	}
 	printf( "\nNextData:       " ); // NEXT/SGLCRC
 	for ( int state = 0; state < 7; ++state ) {
-		if ( opcode[ state ] & 0b00100000 ) {
-			if ( opcode[ state ] & 0b00000100 )
+		if ( opcode[ state ].bits().sgl ) {
+			if ( opcode[ state ].bits().next )
 				printf( "   UDMACRC" );
 			else
 				printf( "    SGLDAT" );
 		} else {
-			if ( opcode[ state ] & 0b00000100 )
+			if ( opcode[ state ].bits().next )
 				printf( "      ++  " );
 			else
 				printf( "          " );
@@ -94,7 +128,7 @@ int main() {
 	}
 	printf( "\nInt Trig:      " ); // GINT
 	for ( int state = 0; state < 7; ++state ) {
-		if ( opcode[ state ] & 0b00010000 )
+		if ( opcode[ state ].bits().gint )
 			printf( "      INT4" );
 		else
 			printf( "          " );
@@ -102,18 +136,18 @@ int main() {
 
 	printf( "\ncycles:         " ); // LENGTH/BRANCH
 	for ( int state = 0; state < 7; ++state ) {
-		if ( opcode[ state ] & 0b00000001 ) { // DP
+		if ( opcode[ state ].bits().dp ) { // DP
 			printf( "       1  " );
 		} else { // NDP
-			if ( len_br[ state ] )
-				printf( "     %3d  ", len_br[ state ] );
+			if ( len_br[ state ].byte )
+				printf( "     %3d  ", len_br[ state ].byte );
 			else
 				printf( "      256 " );
 		}
 	}
 	printf( "\n                " ); // LENGTH/BRANCH
 	for ( int state = 0; state < 7; ++state ) {
-		if ( opcode[ state ] & 0b00000001 ) { // DP
+		if ( opcode[ state ].bits().dp ) { // DP
 			printf( "      if  " );
 		} else {
 			printf( "          " );
@@ -121,47 +155,47 @@ int main() {
 	}
 	printf( "\n                " ); // LENGTH/BRANCH
 	for ( int state = 0; state < 7; ++state ) {
-		if ( opcode[ state ] & 0b00000001 ) { // DP
-			printf( "   %s", term[ (logic[ state ] >> 3) & 0x07 ] );
+		if ( opcode[ state ].bits().dp ) { // DP
+			printf( "   %s", term[ logic[ state ].bits().terma ] );
 		} else { // NDP
 			printf( "          " );
 		}
 	}
 	printf( "\n                " ); // LENGTH/BRANCH
 	for ( int state = 0; state < 7; ++state ) {
-		if ( opcode[ state ] & 0b00000001 ) { // DP
-			printf( "     %s ", lfunc[ (logic[ state ] >> 6) & 0x03 ] );
+		if ( opcode[ state ].bits().dp ) { // DP
+			printf( "     %s ", lfunc[ logic[ state ].bits().lfunc ] );
 		} else { // NDP
 			printf( "          " );
 		}
 	}
 	printf( "\n                " ); // LENGTH/BRANCH
 	for ( int state = 0; state < 7; ++state ) {
-		if ( opcode[ state ] & 0b00000001 ) { // DP
-			printf( "   %s", term[ logic[ state ] & 0x07 ] );
+		if ( opcode[ state ].bits().dp ) { // DP
+			printf( "   %s", term[ logic[ state ].bits().termb ] );
 		} else { // NDP
 			printf( "          " );
 		}
 	}
 	printf( "\n                " ); // LENGTH/BRANCH
 	for ( int state = 0; state < 7; ++state ) {
-		if ( opcode[ state ] & 0b00000001 ) { // DP
-			printf( "    then %d", (len_br[ state ] >> 3) & 0x07 );
+		if ( opcode[ state ].bits().dp ) { // DP
+			printf( "    then %u", unsigned( len_br[ state ].bits().branchon1 ) );
 		} else { // NDP
 			printf( "          " );
 		}
 	}
 	printf( "\n                " ); // LENGTH/BRANCH
 	for ( int state = 0; state < 7; ++state ) {
-		if ( opcode[ state ] & 0b00000001 ) { // DP
-			printf( "    else %d", len_br[ state ] & 0x07 );
+		if ( opcode[ state ].bits().dp ) { // DP
+			printf( "    else %u", unsigned( len_br[ state ].bits().branchon0 ) );
 		} else { // NDP
 			printf( "          " );
 		}
 	}
 	printf( "\nReExecute:      " ); // LENGTH/BRANCH
 	for ( int state = 0; state < 7; ++state ) {
-		if ( ( opcode[ state ] & 0b00000001 ) && len_br[ state ] & 0x80 ) { // DP
+		if ( ( opcode[ state ].bits().dp ) && len_br[ state ].bits().reexecute ) { // DP
 			printf( "    ReExec");
 		} else { // NDP
 			printf( "          " );
@@ -171,22 +205,303 @@ int main() {
 	for ( int ctl = 0; ctl < 4; ++ctl ){
 		printf( "\nCTL%d:         ", ctl );
 		for ( int state = 0; state < 7; ++state ) {
-			switch ( ( output[ state ] >> ctl ) & 0b00010001 ) {
-			    case 0x00:
-			    case 0x01:
+			const auto bits = output[ state ].bits1();
+			const unsigned level[ 4 ] = { bits.ctl0, bits.ctl1, bits.ctl2, bits.ctl3 };
+			const unsigned oe[ 4 ] = { bits.oes0, bits.oes1, bits.oes2, bits.oes3 };
+
+			if ( !oe[ ctl ] )
 				printf( "          " );
-				break;
-			    case 0x10:
-				printf( "         0" );
-				break;
-			    case 0x11:
+			else if ( level[ ctl ] )
 				printf( "         1" );
-				break;
-			}
+			else
+				printf( "         0" );
 		}
 	}
 	printf( "\n" );
+}
+
+//////////////////////////////////////////////////////////////////////
+// Timing diagrams: the states passed from state 0 with constant
+// inputs until the machine state repeats (loop) or idle
+//////////////////////////////////////////////////////////////////////
+
+struct s_segment {
+	unsigned	state;		// 0..6
+	unsigned	start;		// 1st cycle
+	unsigned	cycles;
+	u_output	output;
+	u_opcode	actions;	// Fired in the 1st cycle
+};
+
+struct s_timeline {
+	std::vector<s_segment> segments;
+	unsigned	cycles;		// Shown
+	unsigned	loop_start;	// 1st cycle of the loop, 0 with idle
+	bool		idle;		// Goes idle instead of looping
+	bool		complete;	// false: cut off
+	unsigned	strobes;	// DATA strobes in the loop / pass
+};
+
+static s_timeline timeline( const s_state states[ 8 ], unsigned inputs ) {
+	std::map<uint32_t,unsigned> seen; // Machine state -> cycle
+	std::vector<unsigned> data;
+	s_timeline t = { {}, 0, 0, false, false, 0 };
+	s_machine m;
+
+	machine_reset( m, states );
+	for ( ; t.cycles < 7 * 256 * 2; ++t.cycles ) {
+		if ( m.state >= 7 ) {
+			t.idle = t.complete = true;
+			break;
+		}
+		const uint32_t key = m.state | m.remain << 3 | uint32_t( m.fresh ) << 12;
+		auto it = seen.find( key );
+		if ( it != seen.end() ) {
+			t.loop_start = it->second;
+			t.complete = true;
+			break;
+		}
+		seen[ key ] = t.cycles;
+
+		u_opcode actions;
+		actions.byte = machine_actions( m, states );
+		if ( m.fresh || t.segments.empty() || t.segments.back().state != m.state ) {
+			s_segment seg;
+			seg.state = m.state;
+			seg.start = t.cycles;
+			seg.cycles = 0;
+			seg.output = states[ m.state ].output;
+			seg.actions = actions;
+			t.segments.push_back( seg );
+		}
+		++t.segments.back().cycles;
+		if ( actions.bits().data )
+			data.push_back( t.cycles );
+		machine_step( m, states, inputs );
+	}
+	for ( unsigned cycle : data )
+		if ( cycle >= t.loop_start )
+			++t.strobes;
+	return t;
+}
+
+static std::string xml( const std::string& text ) {
+	std::string out;
+
+	for ( char c : text ) {
+		switch ( c ) {
+		case '<':	out += "&lt;"; break;
+		case '>':	out += "&gt;"; break;
+		case '&':	out += "&amp;"; break;
+		case '"':	out += "&quot;"; break;
+		default:	out += c;
+		}
+	}
+	return out;
+}
+
+static const double svg_left = 64, svg_width = 900, row = 24;
+
+static unsigned diagram_height( bool trictl ) {
+	return unsigned( ( 3 + ( trictl ? 4 : 6 ) + 3 ) * row + 16 );
+}
+
+// One diagram at y, IFCLK in Hz (0: unknown)
+static void render_svg( FILE *out, const s_wavetable& table, double y, double ifclk, unsigned inputs, bool trictl ) {
+	s_state states[ 8 ];
+	char text[ 256 ];
+
+	table_states( table, states );
+
+	const s_timeline t = timeline( states, inputs );
+	const unsigned ctls = trictl ? 4 : 6;
+	const double scale = svg_width / ( t.cycles ? t.cycles : 1 );
+	auto x = [&]( unsigned cycle ) { return svg_left + cycle * scale; };
+	double ry = y;
+
+	// Title and loop annotation
+	fprintf( out, "<g font-family=\"monospace\" font-size=\"12\">\n" );
+	if ( ifclk > 0 )
+		snprintf( text, sizeof text, "IFCLK %g MHz, %.3g ns/cycle", ifclk / 1e6, 1e9 / ifclk );
+	else
+		snprintf( text, sizeof text, "IFCLK unknown" );
+	fprintf( out, "<text x=\"4\" y=\"%.1f\" font-weight=\"bold\">%s: waveform %s, %s</text>\n",
+		ry + 16, xml( table.file ).c_str(), xml( table.name ).c_str(), text );
+	ry += row;
 
+	const unsigned period = t.cycles - t.loop_start;
+	if ( !t.complete )
+		snprintf( text, sizeof text, "input dependent, cut off after %u cycles", t.cycles );
+	else if ( t.idle )
+		snprintf( text, sizeof text, "%u cycle%s to idle, DATA strobes %u", period, period == 1 ? "" : "s", t.strobes );
+	else
+		snprintf( text, sizeof text, "loop of %u cycle%s from cycle %u, DATA strobes %u",
+			period, period == 1 ? "" : "s", t.loop_start, t.strobes );
+	std::string note = text;
+	if ( t.complete && ifclk > 0 ) {
+		snprintf( text, sizeof text, ", %.1f ns", period * 1e9 / ifclk );
+		note += text;
+		if ( t.strobes ) {
+			const double rate = t.strobes * ifclk / period;
+			if ( rate >= 1e6 )
+				snprintf( text, sizeof text, ", %.3f MS/s", rate / 1e6 );
+			else
+				snprintf( text, sizeof text, ", %.3f kS/s", rate / 1e3 );
+			note += text;
+		}
+	}
+	fprintf( out, "<text x=\"4\" y=\"%.1f\">inputs 0x%02X: %s</text>\n", ry + 16, inputs, xml( note ).c_str() );
+	ry += row;
+
+	// States, as wide as their cycles
+	fprintf( out, "<text x=\"4\" y=\"%.1f\">state</text>\n", ry + 16 );
+	for ( auto& seg : t.segments ) {
+		const double w = seg.cycles * scale;
+
+		fprintf( out, "<rect x=\"%.2f\" y=\"%.1f\" width=\"%.2f\" height=\"%.1f\" fill=\"%s\" stroke=\"#444\" stroke-width=\"0.5\">"
+			"<title>$%u: %u cycle%s from cycle %u</title></rect>\n",
+			x( seg.start ), ry + 2, w, row - 4, states[ seg.state ].opcode.bits().dp ? "#fde6b0" : "#cfe3f7",
+			seg.state, seg.cycles, seg.cycles == 1 ? "" : "s", seg.start );
+		if ( w >= 56 )
+			fprintf( out, "<text x=\"%.2f\" y=\"%.1f\">$%u %u</text>\n", x( seg.start ) + 3, ry + 16, seg.state, seg.cycles );
+		else if ( w >= 20 )
+			fprintf( out, "<text x=\"%.2f\" y=\"%.1f\">$%u</text>\n", x( seg.start ) + 3, ry + 16, seg.state );
+	}
+	ry += row;
+
+	// CTL levels, tri-state at mid level on grey
+	for ( unsigned ctl = 0; ctl < ctls; ++ctl ) {
+		std::string path;
+
+		fprintf( out, "<text x=\"4\" y=\"%.1f\">CTL%u</text>\n", ry + 16, ctl );
+		for ( auto& seg : t.segments ) {
+			const unsigned level = ( seg.output.byte >> ctl ) & 1;
+			const bool driven = !trictl || ( ( seg.output.byte >> ( ctl + 4 ) ) & 1 );
+			const double ly = !driven ? ry + row / 2 : level ? ry + 4 : ry + row - 4;
+
+			if ( !driven )
+				fprintf( out, "<rect x=\"%.2f\" y=\"%.1f\" width=\"%.2f\" height=\"%.1f\" fill=\"#e8e8e8\"/>\n",
+					x( seg.start ), ry + 4, seg.cycles * scale, row - 8 );
+			snprintf( text, sizeof text, "%s%.2f,%.1f L%.2f,%.1f ", path.empty() ? "M" : "L",
+				x( seg.start ), ly, x( seg.start + seg.cycles ), ly );
+			path += text;
+		}
+		fprintf( out, "<path d=\"%s\" fill=\"none\" stroke=\"#1a5fb4\" stroke-width=\"1.5\"/>\n", path.c_str() );
+		ry += row;
+	}
+
+	// Strobes in the 1st cycle of their state
+	static const char *strobes[] = { "DATA", "NEXT", "GINT" };
+	for ( unsigned sx = 0; sx < 3; ++sx ) {
+		fprintf( out, "<text x=\"4\" y=\"%.1f\">%s</text>\n", ry + 16, strobes[ sx ] );
+		for ( auto& seg : t.segments ) {
+			const unsigned fired = sx == 0 ? seg.actions.bits().data : sx == 1 ? seg.actions.bits().next : seg.actions.bits().gint;
+			if ( fired )
+				fprintf( out, "<line x1=\"%.2f\" y1=\"%.1f\" x2=\"%.2f\" y2=\"%.1f\" stroke=\"#c01c28\" stroke-width=\"1.5\"/>\n",
+					x( seg.start ), ry + 4, x( seg.start ), ry + row - 4 );
+		}
+		ry += row;
+	}
+
+	// Loop bracket
+	if ( t.complete && !t.idle ) {
+		fprintf( out, "<path d=\"M%.2f,%.1f L%.2f,%.1f L%.2f,%.1f L%.2f,%.1f\" fill=\"none\" stroke=\"#26a269\"/>\n",
+			x( t.loop_start ), ry, x( t.loop_start ), ry + 6, x( t.cycles ), ry + 6, x( t.cycles ), ry );
+		fprintf( out, "<text x=\"%.2f\" y=\"%.1f\" fill=\"#26a269\">loop %u</text>\n",
+			x( t.loop_start ) + 3, ry + 18, period );
+	}
+	fprintf( out, "</g>\n" );
+}
+
+// Binary image of 1..4 slots
+static bool read_image( const std::string& path, std::vector<s_wavetable>& tables, std::string& error ) {
+	std::ifstream is( path, std::ios::binary );
+	std::vector<char> raw( ( std::istreambuf_iterator<char>( is ) ), std::istreambuf_iterator<char>() );
+
+	if ( raw.empty() || raw.size() % 32 || raw.size() > 128 )
+		return false;
+	for ( size_t ox = 0; ox < raw.size(); ox += 32 ) {
+		s_wavetable table;
+		table.file = path;
+		table.name = std::to_string( ox / 32 );
+		table.ifconfig = -1;
+		memcpy( table.bytes, raw.data() + ox, 32 );
+		tables.push_back( table );
+	}
+	error.clear();
+	return true;
+}
+
+int main( int argc, char **argv ) {
+	enum { Ascii, Svg, Html } format = Ascii;
+	double ifclk = 0;
+	unsigned inputs = 0xFF;
+	bool trictl = true;
+	std::vector<s_wavetable> tables;
+	std::string error;
+
+	for ( int ax = 1; ax < argc; ++ax ) {
+		if ( !strcmp( argv[ ax ], "--svg" ) )
+			format = Svg;
+		else if ( !strcmp( argv[ ax ], "--html" ) )
+			format = Html;
+		else if ( !strncmp( argv[ ax ], "--ifclk=", 8 ) )
+			ifclk = strtod( argv[ ax ] + 8, nullptr );
+		else if ( !strncmp( argv[ ax ], "--inputs=", 9 ) )
+			inputs = strtoul( argv[ ax ] + 9, nullptr, 0 ) & 0xFF;
+		else if ( !strcmp( argv[ ax ], "--trictl=0" ) || !strcmp( argv[ ax ], "--trictl=1" ) )
+			trictl = argv[ ax ][ 9 ] == '1';
+		else if ( argv[ ax ][ 0 ] == '-' ) {
+			fprintf( stderr, "Usage: %s [--svg|--html] [--ifclk=hz] [--inputs=n] [--trictl=0|1] [file.inc|image.bin]...\n", argv[ 0 ] );
+			exit( 2 );
+		} else if ( !read_tables( argv[ ax ], tables, error ) && !read_image( argv[ ax ], tables, error ) ) {
+			fprintf( stderr, "*** ERROR: %s\n", error.c_str() );
+			exit( 1 );
+		}
+	}
+
+	if ( tables.empty() ) {
+		if ( format == Ascii ) {
+			show_ascii( get_waveform( stdin ) );
+			return 0;
+		}
+		if ( !read_tables( "-", tables, error ) ) {
+			fprintf( stderr, "*** ERROR: %s\n", error.c_str() );
+			exit( 1 );
+		}
+	}
+
+	if ( format == Ascii ) {
+		for ( auto& table : tables ) {
+			printf( "%s: waveform %s\n\n", table.file.c_str(), table.name.c_str() );
+			show_ascii( table.bytes );
+			printf( "\n" );
+		}
+		return 0;
+	}
+
+	const unsigned height = diagram_height( trictl );
+	const unsigned width = unsigned( svg_left + svg_width + 16 );
+
+	if ( format == Html )
+		printf( "<!DOCTYPE html>\n<html><head><meta charset=\"utf-8\"><title>GPIF timing</title></head><body>\n" );
+	else
+		printf( "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%u\" height=\"%u\">\n<rect width=\"100%%\" height=\"100%%\" fill=\"white\"/>\n",
+			width, height * unsigned( tables.size() ) );
+	for ( size_t tx = 0; tx < tables.size(); ++tx ) {
+		const s_wavetable& table = tables[ tx ];
+		double clk = ifclk;
+
+		if ( clk <= 0 && table.ifconfig >= 0 && ( table.ifconfig & 0x80 ) )
+			clk = table.ifconfig & 0x40 ? 48e6 : 30e6;
+		if ( format == Html ) {
+			printf( "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%u\" height=\"%u\">\n", width, height );
+			render_svg( stdout, table, 0, clk, inputs, trictl );
+			printf( "</svg><br>\n" );
+		} else
+			render_svg( stdout, table, double( height * tx ), clk, inputs, trictl );
+	}
+	printf( format == Html ? "</body></html>\n" : "</svg>\n" );
 	return 0;
 }
 
@@ -0,0 +1,165 @@
+//////////////////////////////////////////////////////////////////////
+// gpif_sim.h -- GPIF state timing model, shared by the tools
+///////////////////////////////////////////////////////////////////////
+//
+// A waveform is 7 states (0..6) plus the idle state 7. An NDP state
+// lasts its count (0 == 256) IFCLK cycles and continues with the next
+// state, a DP state lasts one cycle and branches to branchon1 if its
+// logic function is true, else to branchon0.
+
+struct s_state {
+	u_branch		branch;
+	u_opcode		opcode;
+	u_logfunc		logfunc;
+	u_output		output;
+};
+
+struct s_loop {
+	bool			deterministic;	// false: branch depends on inputs
+	bool			idle;		// true: ends in idle state 7
+	unsigned		start;		// 1st state of the loop
+	unsigned		period;		// IFCLK cycles per loop (or to idle)
+	unsigned		strobes;	// DATA strobes per loop
+};
+
+inline unsigned
+state_cycles(const s_state& state) {
+	if ( state.opcode.bits().dp )
+		return 1;
+	return state.branch.byte ? state.branch.byte : 256;
+}
+
+// Next state, if it does not depend on the inputs
+inline bool
+next_state(const s_state& state,unsigned statex,unsigned& next) {
+	if ( !state.opcode.bits().dp ) {
+		next = statex + 1;
+		return true;
+	}
+	if ( state.branch.bits().branchon0 != state.branch.bits().branchon1 )
+		return false;
+	next = state.branch.bits().branchon1;
+	return true;
+}
+
+// Follow the waveform from state 0 while it does not depend on inputs
+inline s_loop
+find_loop(const s_state states[7]) {
+	s_loop loop = { false, false, 0, 0, 0 };
+	unsigned cycles[8];		// Cycle of 1st entry, ~0u: not visited
+	unsigned strobes[8];
+	unsigned statex = 0, now = 0, data = 0;
+
+	for ( unsigned ux=0; ux<8; ++ux )
+		cycles[ux] = ~0u;
+
+	while ( statex < 7 && cycles[statex] == ~0u ) {
+		const s_state& state = states[statex];
+		unsigned next;
+
+		cycles[statex] = now;
+		strobes[statex] = data;
+		now += state_cycles(state);
+		data += state.opcode.bits().data;
+		if ( !next_state(state,statex,next) )
+			return loop;
+		statex = next;
+	}
+	loop.deterministic = true;
+	if ( statex >= 7 ) {
+		loop.idle = true;
+		loop.period = now;
+		loop.strobes = data;
+	} else	{
+		loop.start = statex;
+		loop.period = now - cycles[statex];
+		loop.strobes = data - strobes[statex];
+	}
+	return loop;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Cycle by cycle execution. Bit n of the inputs is the value of term
+// n of the logic function (RDY0..RDY5/TC, FIFO flag, INTRDY). The
+// opcode actions fire in the first cycle of a state, in a DP that
+// branches to itself again only if re-execute is set. Idle state 7
+// is absorbing.
+//////////////////////////////////////////////////////////////////////
+
+struct s_machine {
+	unsigned		state;		// 0..6, 7 == idle
+	unsigned		remain;		// Cycles left in an NDP state
+	bool			fresh;		// Actions fire in this cycle
+};
+
+inline void
+machine_enter(s_machine& m,const s_state states[8],unsigned statex) {
+	m.state = statex;
+	m.remain = statex < 7 ? state_cycles(states[statex]) : 0;
+	m.fresh = statex < 7;
+}
+
+inline void
+machine_reset(s_machine& m,const s_state states[8]) {
+	machine_enter(m,states,0);
+}
+
+inline bool
+dp_condition(const s_state& state,unsigned inputs) {
+	const bool a = (inputs >> state.logfunc.bits().terma) & 1;
+	const bool b = (inputs >> state.logfunc.bits().termb) & 1;
+
+	switch ( state.logfunc.bits().lfunc ) {
+	case 0b00:
+		return a && b;
+	case 0b01:
+		return a || b;
+	case 0b10:
+		return a != b;
+	default:
+		return !a && b;
+	}
+}
+
+// Terms tested in the current cycle, as a mask of input bits
+inline unsigned
+machine_terms(const s_machine& m,const s_state states[8]) {
+	if ( m.state >= 7 || !states[m.state].opcode.bits().dp )
+		return 0;
+	return 1u << states[m.state].logfunc.bits().terma
+		| 1u << states[m.state].logfunc.bits().termb;
+}
+
+// Opcode bits acting in the current cycle (DP bit excluded)
+inline uint8_t
+machine_actions(const s_machine& m,const s_state states[8]) {
+	if ( m.state >= 7 || !m.fresh )
+		return 0;
+	return states[m.state].opcode.byte & 0x3E;
+}
+
+inline void
+machine_step(s_machine& m,const s_state states[8],unsigned inputs) {
+	if ( m.state >= 7 )
+		return;
+
+	const s_state& state = states[m.state];
+
+	if ( !state.opcode.bits().dp ) {
+		if ( m.remain > 1 ) {
+			--m.remain;
+			m.fresh = false;
+		} else	machine_enter(m,states,m.state + 1);
+		return;
+	}
+
+	unsigned target = dp_condition(state,inputs)
+		? state.branch.bits().branchon1 : state.branch.bits().branchon0;
+
+	if ( target == m.state ) {
+		m.remain = 1;
+		m.fresh = state.branch.bits().reexecute;
+	} else	machine_enter(m,states,target);
+}
+
+// End gpif_sim.h
@@ -0,0 +1,553 @@
+//////////////////////////////////////////////////////////////////////
+// gpif_slots.cpp -- Plan the use of the four FX2 waveform slots
+///////////////////////////////////////////////////////////////////////
+//
+// The FX2 holds four waveforms (WAVEDATA slots 0..3, 32 bytes each).
+// A firmware with more tables copies them in on a mode change. Given
+// the modes (the tables used together, with their GPIFWFSELECT role)
+// and how often the firmware switches between them, this assigns each
+// table a fixed slot so that the expected bytes reloaded per switch
+// are lowest, and emits the slot map and a C loader:
+//
+//    $ ./gpif_slots [--restarts=n] plan.txt file.inc...
+//
+// PLAN:
+//	MODE	name table[=ROLE]...	; at most 4 tables used together
+//	SWITCH	from to count		; switches from mode to mode
+//
+// A table is name or file:name of the tables read from the files
+// (gpif_compiler output or gpif.c), ROLE is FIFORD, FIFOWR, SINGLERD
+// or SINGLEWR (the GPIFWFSELECT field pointing to its slot). count is
+// a relative frequency, e.g. per hour.
+//
+// The loader remembers what each slot holds and copies a table only
+// if its slot holds another one, so a slot keeps a table across modes
+// not using it. For a slot map the expected cost is exact for the
+// switch frequencies taken as a Markov chain: the probability that a
+// slot holds table t in mode m follows from the modes switching to m.
+// Tables get slots by a randomized first fit (tables of one mode
+// never share a slot), improved by moving and swapping tables while
+// that lowers the cost, from --restarts=n starts (default 16). A
+// table alone in its slot is resident, loaded once.
+//
+// Each table is emitted as waveform_<file_name>, e.g. slots.inc:48 as
+// waveform_slots_inc_48, so the other tools read it back from the
+// output as slots.h:slots_inc_48.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <map>
+#include <algorithm>
+#include "gpif.h"
+#include "gpif_sim.h"
+#include "gpif_table.h"
+
+
+static const unsigned slots = 4;
+static const char *roles[slots] = { "FIFORD", "FIFOWR", "SINGLERD", "SINGLEWR" };
+
+struct s_mode {
+	std::string		name;
+	std::vector<unsigned>	tables;		// Indexes into the tables
+	std::vector<int>	roles;		// Per table, -1: none
+};
+
+struct s_switch {
+	unsigned		from, to;	// Modes
+	double			count;
+};
+
+static std::vector<s_wavetable> tables;
+static std::vector<s_mode> modes;
+static std::vector<s_switch> switches;
+static std::vector<std::vector<bool>> conflict;	// Tables used together
+
+//////////////////////////////////////////////////////////////////////
+// Reading the plan
+//////////////////////////////////////////////////////////////////////
+
+static int
+find_table(const std::string& ref,std::string& error) {
+	size_t colon = ref.rfind(':');
+	int found = -1;
+
+	for ( unsigned tx=0; tx<tables.size(); ++tx ) {
+		const s_wavetable& t = tables[tx];
+
+		if ( colon == std::string::npos ? t.name != ref
+		  : t.file != ref.substr(0,colon) || t.name != ref.substr(colon+1) )
+			continue;
+		if ( found >= 0 ) {
+			error = "table '" + ref + "' is ambiguous, use file:name";
+			return -1;
+		}
+		found = tx;
+	}
+	if ( found < 0 )
+		error = "no table '" + ref + "'";
+	return found;
+}
+
+static int
+find_mode(const std::string& name) {
+	for ( unsigned mx=0; mx<modes.size(); ++mx )
+		if ( modes[mx].name == name )
+			return mx;
+	return -1;
+}
+
+static bool
+read_plan(std::istream& is,std::string& error) {
+	std::string line;
+	unsigned lineno = 0;
+
+	while ( std::getline(is,line) ) {
+		std::vector<std::string> tokens;
+		std::istringstream ls(line);
+		std::string t, err;
+
+		++lineno;
+		while ( ls >> t && t[0] != ';' )
+			tokens.push_back(t);
+		if ( tokens.empty() )
+			continue;
+
+		if ( tokens[0] == "MODE" ) {
+			s_mode mode;
+
+			if ( tokens.size() < 3 || tokens.size() > 2 + slots )
+				err = "expected MODE name table[=ROLE]... (1..4 tables)";
+			else if ( find_mode(tokens[1]) >= 0 )
+				err = "mode '" + tokens[1] + "' defined twice";
+			mode.name = tokens.size() > 1 ? tokens[1] : "";
+			for ( size_t ox=2; err.empty() && ox<tokens.size(); ++ox ) {
+				std::string ref = tokens[ox];
+				int role = -1;
+				size_t eq = ref.find('=');
+
+				if ( eq != std::string::npos ) {
+					for ( unsigned rx=0; rx<slots; ++rx )
+						if ( ref.substr(eq+1) == roles[rx] )
+							role = rx;
+					if ( role < 0 ) {
+						err = "invalid role '" + ref.substr(eq+1) + "'";
+						break;
+					}
+					ref = ref.substr(0,eq);
+				}
+
+				int tx = find_table(ref,err);
+
+				if ( tx < 0 )
+					break;
+				if ( std::find(mode.tables.begin(),mode.tables.end(),unsigned(tx)) != mode.tables.end() )
+					err = "table '" + ref + "' twice in mode " + mode.name;
+				else if ( role >= 0 && std::find(mode.roles.begin(),mode.roles.end(),role) != mode.roles.end() )
+					err = std::string("role ") + roles[role] + " twice in mode " + mode.name;
+				mode.tables.push_back(tx);
+				mode.roles.push_back(role);
+			}
+			if ( err.empty() )
+				modes.push_back(mode);
+		} else if ( tokens[0] == "SWITCH" ) {
+			s_switch sw;
+			char *ep = nullptr;
+			int from = tokens.size() == 4 ? find_mode(tokens[1]) : -1;
+			int to = tokens.size() == 4 ? find_mode(tokens[2]) : -1;
+
+			sw.count = tokens.size() == 4 ? strtod(tokens[3].c_str(),&ep) : 0;
+			if ( tokens.size() != 4 )
+				err = "expected SWITCH from to count";
+			else if ( from < 0 || to < 0 )
+				err = "unknown mode '" + tokens[from < 0 ? 1 : 2] + "'";
+			else if ( *ep || sw.count < 0 )
+				err = "invalid count '" + tokens[3] + "'";
+			else if ( from != to && sw.count > 0 ) {
+				sw.from = from;
+				sw.to = to;
+				switches.push_back(sw);
+			}
+		} else	err = "unknown statement '" + tokens[0] + "'";
+
+		if ( !err.empty() ) {
+			error = "line " + std::to_string(lineno) + ": " + err;
+			return false;
+		}
+	}
+	if ( modes.empty() ) {
+		error = "no MODE";
+		return false;
+	}
+	if ( switches.empty() ) {
+		error = "no SWITCH with a count";
+		return false;
+	}
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Cost of a slot map, per slot
+//////////////////////////////////////////////////////////////////////
+
+// Table of mode m in slot s, -1: none
+static int
+occupant(const std::vector<unsigned>& slot,unsigned m,unsigned s) {
+	for ( auto tx : modes[m].tables )
+		if ( slot[tx] == s )
+			return tx;
+	return -1;
+}
+
+// Expected bytes copied into slot s per unit of switch count
+static double
+slot_cost(const std::vector<unsigned>& slot,unsigned s) {
+	const unsigned nmodes = modes.size();
+	std::vector<int> occ(nmodes);
+	std::vector<unsigned> users;		// Tables in slot s
+	double cost = 0;
+
+	for ( unsigned mx=0; mx<nmodes; ++mx )
+		occ[mx] = occupant(slot,mx,s);
+	for ( unsigned tx=0; tx<slot.size(); ++tx )
+		if ( slot[tx] == s )
+			users.push_back(tx);
+	if ( users.size() <= 1 )
+		return 0;			// Resident
+
+	// p[m]: probability that slot s holds table t in mode m
+	std::vector<double> p(nmodes), inflow(nmodes,0);
+
+	for ( auto& sw : switches )
+		inflow[sw.to] += sw.count;
+
+	for ( auto tx : users ) {
+		std::fill(p.begin(),p.end(),0.0);
+		for ( unsigned mx=0; mx<nmodes; ++mx )
+			p[mx] = occ[mx] == int(tx);
+		for ( unsigned iter=0; iter<1000; ++iter ) {
+			std::vector<double> q(nmodes,0.0);
+			double change = 0;
+
+			for ( auto& sw : switches )
+				q[sw.to] += sw.count * p[sw.from];
+			for ( unsigned mx=0; mx<nmodes; ++mx ) {
+				if ( occ[mx] >= 0 || inflow[mx] <= 0 )
+					continue;
+				q[mx] /= inflow[mx];
+				change = std::max(change,fabs(q[mx] - p[mx]));
+				p[mx] = q[mx];
+			}
+			if ( change < 1e-12 )
+				break;
+		}
+		for ( auto& sw : switches )
+			if ( occ[sw.to] == int(tx) )
+				cost += sw.count * 32 * (1 - p[sw.from]);
+	}
+	return cost;
+}
+
+static double
+total_cost(const std::vector<unsigned>& slot,std::vector<double>& per_slot) {
+	double cost = 0;
+
+	per_slot.resize(slots);
+	for ( unsigned s=0; s<slots; ++s )
+		cost += per_slot[s] = slot_cost(slot,s);
+	return cost;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Search
+//////////////////////////////////////////////////////////////////////
+
+static uint32_t rng = 1;
+
+static uint32_t
+xorshift() {
+	rng ^= rng << 13;
+	rng ^= rng >> 17;
+	rng ^= rng << 5;
+	return rng;
+}
+
+static bool
+fits(const std::vector<unsigned>& slot,unsigned tx,unsigned s) {
+	for ( unsigned ux=0; ux<slot.size(); ++ux )
+		if ( ux != tx && slot[ux] == s && conflict[tx][ux] )
+			return false;
+	return true;
+}
+
+// Backtracking first fit in the order given, slots tried from a
+// random start
+static bool
+color(std::vector<unsigned>& slot,const std::vector<unsigned>& order,unsigned ox) {
+	if ( ox >= order.size() )
+		return true;
+
+	const unsigned tx = order[ox], first = xorshift() % slots;
+
+	for ( unsigned sx=0; sx<slots; ++sx ) {
+		const unsigned s = (first + sx) % slots;
+
+		if ( fits(slot,tx,s) ) {
+			slot[tx] = s;
+			if ( color(slot,order,ox+1) )
+				return true;
+		}
+	}
+	slot[tx] = slots;
+	return false;
+}
+
+// Move and swap tables while the cost drops
+static double
+improve(std::vector<unsigned>& slot,const std::vector<unsigned>& used) {
+	std::vector<double> per_slot;
+	double cost = total_cost(slot,per_slot);
+	bool better = true;
+
+	while ( better ) {
+		better = false;
+		for ( unsigned ix=0; ix<used.size(); ++ix ) {
+			const unsigned tx = used[ix];
+
+			for ( unsigned s=0; s<slots; ++s ) {
+				const unsigned was = slot[tx];
+
+				if ( s == was || !fits(slot,tx,s) )
+					continue;
+				slot[tx] = s;
+
+				const double c = cost - per_slot[was] - per_slot[s]
+					+ slot_cost(slot,was) + slot_cost(slot,s);
+
+				if ( c < cost - 1e-9 ) {
+					cost = total_cost(slot,per_slot);
+					better = true;
+				} else	slot[tx] = was;
+			}
+			for ( unsigned jx=ix+1; jx<used.size(); ++jx ) {
+				const unsigned ux = used[jx], a = slot[tx], b = slot[ux];
+
+				if ( a == b )
+					continue;
+				slot[tx] = b;
+				slot[ux] = a;
+				if ( fits(slot,tx,b) && fits(slot,ux,a) ) {
+					const double c = cost - per_slot[a] - per_slot[b]
+						+ slot_cost(slot,a) + slot_cost(slot,b);
+
+					if ( c < cost - 1e-9 ) {
+						cost = total_cost(slot,per_slot);
+						better = true;
+						continue;
+					}
+				}
+				slot[tx] = a;
+				slot[ux] = b;
+			}
+		}
+	}
+	return cost;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Output
+//////////////////////////////////////////////////////////////////////
+
+static std::string
+c_name(const std::string& name) {
+	std::string s;
+
+	for ( char c : name )
+		s += isalnum((unsigned char)c) ? c : '_';
+	return s;
+}
+
+static void
+emit(std::ostream& out,const std::vector<unsigned>& slot,const std::vector<unsigned>& used,
+  double cost,double naive,double total) {
+	std::map<unsigned,unsigned> index;		// Table -> gpif_slot_data row
+
+	for ( unsigned ix=0; ix<used.size(); ++ix )
+		index[used[ix]] = ix;
+
+	out << "// gpif_slots: expected " << std::fixed << std::setprecision(1) << cost / total
+		<< " bytes reloaded per switch, " << naive / total << " reloading every table of the mode\n"
+		<< "// Tables are file:name, the name being the waveform number or WaveData slot\n"
+		<< "//\n";
+	for ( unsigned s=0; s<slots; ++s ) {
+		std::vector<unsigned> in;
+
+		for ( auto tx : used )
+			if ( slot[tx] == s )
+				in.push_back(tx);
+		out << "// slot " << s << ':';
+		for ( auto tx : in )
+			out << ' ' << tables[tx].file << ':' << tables[tx].name;
+		out << (in.empty() ? " unused" : in.size() == 1 ? " (resident)" : " (swapped)") << '\n';
+	}
+
+	out << "\n#define GPIF_SLOT_TABLES " << used.size() << '\n'
+		<< "#define GPIF_MODES " << modes.size() << "\n\n"
+		<< std::uppercase << std::hex;
+	for ( auto tx : used ) {
+		out << "// " << tables[tx].file << ':' << tables[tx].name << ", slot " << std::dec << slot[tx] << std::hex << '\n'
+			<< "static const unsigned char waveform_" << c_name(tables[tx].file + ':' + tables[tx].name) << "[ 32 ] = {";
+		for ( unsigned bx=0; bx<32; ++bx )
+			out << (bx % 8 ? "," : bx ? ",\n\t" : "\n\t") << "0x" << std::setw(2) << std::setfill('0') << unsigned(tables[tx].bytes[bx]);
+		out << "\n};\n\n";
+	}
+	out << std::dec << std::nouppercase << std::setfill(' ')
+		<< "static const unsigned char * const gpif_slot_data[ GPIF_SLOT_TABLES ] = {\n";
+	for ( auto tx : used )
+		out << "\twaveform_" << c_name(tables[tx].file + ':' + tables[tx].name) << ",\n";
+	out << "};\n\n";
+
+	out << "struct gpif_mode {\n"
+		<< "\tunsigned char\t\twfselect;\t// GPIFWFSELECT\n"
+		<< "\tunsigned char\t\ttable[ 4 ];\t// gpif_slot_data row per slot, 0xFF: keep\n"
+		<< "};\n\n"
+		<< "static const struct gpif_mode gpif_modes[ GPIF_MODES ] = {\n";
+	for ( auto& mode : modes ) {
+		unsigned wfselect = 0;
+		char buf[64];
+		int row[slots] = { 0xFF, 0xFF, 0xFF, 0xFF };
+
+		for ( unsigned ox=0; ox<mode.tables.size(); ++ox ) {
+			const unsigned tx = mode.tables[ox];
+
+			row[slot[tx]] = index[tx];
+			if ( mode.roles[ox] >= 0 )
+				wfselect |= slot[tx] << (2 * mode.roles[ox]);
+		}
+		snprintf(buf,sizeof buf,"\t{ 0x%02X, { 0x%02X,0x%02X,0x%02X,0x%02X } },",wfselect,row[0],row[1],row[2],row[3]);
+		out << buf << "\t// " << mode.name << ':';
+		for ( auto tx : mode.tables )
+			out << ' ' << tables[tx].file << ':' << tables[tx].name;
+		out << '\n';
+	}
+	out << "};\n\n"
+		<< "static unsigned char gpif_slot_loaded[ 4 ] = { 0xFF,0xFF,0xFF,0xFF };\n\n"
+		<< "// Copy the tables of mode into their slots unless there already, set GPIFWFSELECT\n"
+		<< "static void\n"
+		<< "gpif_select_mode( unsigned char mode ) {\n"
+		<< "\tconst struct gpif_mode *m = &gpif_modes[ mode ];\n"
+		<< "\tunsigned char s, b;\n\n"
+		<< "\tfor ( s = 0; s < 4; ++s ) {\n"
+		<< "\t\tconst unsigned char t = m->table[ s ];\n"
+		<< "\t\t__xdata volatile unsigned char *dst = (__xdata volatile unsigned char *)( 0xE400 + 32 * s );\n\n"
+		<< "\t\tif ( t == 0xFF || gpif_slot_loaded[ s ] == t )\n"
+		<< "\t\t\tcontinue;\n"
+		<< "\t\tfor ( b = 0; b < 32; ++b )\n"
+		<< "\t\t\tdst[ b ] = gpif_slot_data[ t ][ b ];\n"
+		<< "\t\tgpif_slot_loaded[ s ] = t;\n"
+		<< "\t}\n"
+		<< "\tGPIFWFSELECT = m->wfselect;\n"
+		<< "}\n";
+}
+
+int
+main(int argc,char **argv) {
+	std::string plan_path, error;
+	std::vector<std::string> files;
+	unsigned restarts = 16;
+
+	for ( int ax=1; ax < argc; ++ax ) {
+		if ( !strncmp(argv[ax],"--restarts=",11) )
+			restarts = strtoul(argv[ax]+11,nullptr,10);
+		else if ( argv[ax][0] == '-' && argv[ax][1] ) {
+			files.clear();
+			break;
+		} else if ( plan_path.empty() )
+			plan_path = argv[ax];
+		else	files.push_back(argv[ax]);
+	}
+	if ( files.empty() ) {
+		std::cerr << "Usage: " << argv[0] << " [--restarts=n] plan.txt file.inc...\n";
+		exit(2);
+	}
+	for ( auto& file : files ) {
+		if ( !read_tables(file,tables,error) ) {
+			std::cerr << "*** ERROR: " << error << '\n';
+			exit(1);
+		}
+	}
+
+	std::ifstream is(plan_path);
+
+	if ( !is ) {
+		std::cerr << "*** ERROR: " << strerror(errno) << ": opening " << plan_path << '\n';
+		exit(1);
+	}
+	if ( !read_plan(is,error) ) {
+		std::cerr << "*** ERROR: " << plan_path << ": " << error << '\n';
+		exit(1);
+	}
+
+	// Tables in some mode, tables used together
+	std::vector<unsigned> used;
+
+	conflict.assign(tables.size(),std::vector<bool>(tables.size(),false));
+	for ( auto& mode : modes ) {
+		for ( auto tx : mode.tables ) {
+			if ( std::find(used.begin(),used.end(),tx) == used.end() )
+				used.push_back(tx);
+			for ( auto ux : mode.tables )
+				conflict[tx][ux] = tx != ux;
+		}
+	}
+
+	// Fit the most constrained tables first
+	std::vector<unsigned> order = used;
+	std::vector<unsigned> best;
+	double best_cost = 0;
+
+	std::stable_sort(order.begin(),order.end(),[](unsigned a,unsigned b) {
+		return std::count(conflict[a].begin(),conflict[a].end(),true)
+			> std::count(conflict[b].begin(),conflict[b].end(),true);
+	});
+	for ( unsigned rx=0; rx<std::max(restarts,1u); ++rx ) {
+		std::vector<unsigned> slot(tables.size(),slots);
+
+		if ( !color(slot,order,0) ) {
+			std::cerr << "*** ERROR: the tables used together need more than 4 slots\n";
+			exit(1);
+		}
+
+		const double cost = improve(slot,used);
+
+		if ( best.empty() || cost < best_cost - 1e-9 ) {
+			best = slot;
+			best_cost = cost;
+		}
+		if ( rx > 0 )		// Later starts shuffle the order a bit
+			std::swap(order[xorshift() % order.size()],order[xorshift() % order.size()]);
+	}
+
+	double total = 0, naive = 0;
+
+	for ( auto& sw : switches ) {
+		total += sw.count;
+		naive += sw.count * 32 * modes[sw.to].tables.size();
+	}
+	emit(std::cout,best,used,best_cost,naive,total);
+	std::cerr << "; " << used.size() << " tables, " << modes.size() << " modes: " << std::fixed << std::setprecision(1)
+		<< best_cost / total << " bytes reloaded per switch (" << naive / total << " reloading every table)\n";
+	return 0;
+}
+
+// End gpif_slots.cpp
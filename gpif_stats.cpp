@@ -0,0 +1,33 @@
+//////////////////////////////////////////////////////////////////////
+// gpif_stats.cpp -- Heap counters for --stats
+///////////////////////////////////////////////////////////////////////
+//
+// Replaces the global operator new and delete to count heap
+// allocations. Linked once into each tool using gpif_stats.h.
+
+#include <stdlib.h>
+
+#include <cstddef>
+#include <new>
+
+#include "gpif_stats.h"
+
+s_heap heap = { 0, 0 };
+
+void *
+operator new(std::size_t size) {
+	void *p = malloc(size ? size : 1);
+
+	if ( !p )
+		throw std::bad_alloc();
+	++heap.allocs;
+	heap.bytes += size;
+	return p;
+}
+
+void
+operator delete(void *p) noexcept {
+	free(p);
+}
+
+// End gpif_stats.cpp
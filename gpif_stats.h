@@ -0,0 +1,89 @@
+//////////////////////////////////////////////////////////////////////
+// gpif_stats.h -- Phase timing and heap counters for --stats
+///////////////////////////////////////////////////////////////////////
+//
+// gpif_stats.cpp, linked into each tool including this, replaces the
+// global operator new to count heap allocations. A s_phase_timer adds
+// the wall time and the allocations of its scope to a s_phase.
+
+#include <cstddef>
+#include <cstdlib>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+struct s_heap {
+	unsigned long long	allocs;
+	unsigned long long	bytes;
+};
+
+extern s_heap heap;			// gpif_stats.cpp
+
+struct s_phase {
+	const char		*name;
+	unsigned long long	ns;		// Wall time
+	unsigned long long	allocs;		// Heap allocations
+	unsigned long long	bytes;		// Heap bytes allocated
+};
+
+class s_phase_timer {
+	s_phase&		phase;
+	s_heap			heap0;
+	std::chrono::steady_clock::time_point t0;
+
+public:	s_phase_timer(s_phase& ph) : phase(ph), heap0(heap), t0(std::chrono::steady_clock::now()) {}
+
+	~s_phase_timer() {
+		phase.ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - t0).count();
+		phase.allocs += heap.allocs - heap0.allocs;
+		phase.bytes += heap.bytes - heap0.bytes;
+	}
+};
+
+struct s_count {
+	const char		*name;
+	unsigned long long	value;
+};
+
+// Report to stderr, as ';' comment lines or as one JSON line
+inline void
+print_stats(const std::vector<s_phase>& phases,const std::vector<s_count>& counts,bool json) {
+	std::stringstream ss;
+
+	if ( json ) {
+		ss << "{\"stats\":{\"phases\":[";
+		for ( unsigned px=0; px<phases.size(); ++px )
+			ss << (px ? "," : "")
+				<< "{\"phase\":\"" << phases[px].name
+				<< "\",\"ns\":" << phases[px].ns
+				<< ",\"allocs\":" << phases[px].allocs
+				<< ",\"bytes\":" << phases[px].bytes << '}';
+		ss << ']';
+		for ( auto& count : counts )
+			ss << ",\"" << count.name << "\":" << count.value;
+		ss << ",\"heap_allocs\":" << heap.allocs
+			<< ",\"heap_bytes\":" << heap.bytes << "}}\n";
+	} else	{
+		ss << ";\n;\tStatistics:\n;\n"
+			<< ";\tphase            time/us     allocs      bytes\n";
+		for ( auto& phase : phases )
+			ss << ";\t" << std::left << std::setw(12) << phase.name << std::right
+				<< std::setw(12) << std::fixed << std::setprecision(1) << phase.ns / 1e3
+				<< std::setw(11) << phase.allocs
+				<< std::setw(11) << phase.bytes << '\n';
+		ss << ";\n";
+		for ( auto& count : counts )
+			ss << ";\t" << std::left << std::setw(12) << count.name << std::right
+				<< std::setw(12) << count.value << '\n';
+		ss << ";\t" << std::left << std::setw(12) << "heap allocs" << std::right
+			<< std::setw(12) << heap.allocs << '\n'
+			<< ";\t" << std::left << std::setw(12) << "heap bytes" << std::right
+			<< std::setw(12) << heap.bytes << '\n';
+	}
+	std::cerr << ss.str();
+}
+
+// End gpif_stats.h
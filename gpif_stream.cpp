@@ -0,0 +1,466 @@
+//////////////////////////////////////////////////////////////////////
+// gpif_stream.cpp -- Virtual device: the endpoint byte stream of a
+// wave table sampling a synthetic signal
+///////////////////////////////////////////////////////////////////////
+//
+// Runs a compiled wave table (gpif_sim.h) and samples a synthetic
+// signal source standing in for the ADC on PB (channel 1) and PD
+// (channel 2) at every DATA strobe. The bytes the GPIF would put into
+// the endpoint FIFO are written as 512 byte bulk packets, each at the
+// time its last byte is sampled, to load test host capture pipelines
+// without hardware:
+//
+//    $ ./gpif_stream [--ifclk=hz] [--inputs=n] [--channels=1|2]
+//		[--source=spec] [--source2=spec] [--seconds=s|--bytes=n]
+//		[--fast] [--output=path|--socket=path] file.inc[:name]
+//
+// spec is one of (frequencies with K or M suffix, amplitude 0..1):
+//
+//	sine[:freq[:amp]]	Default sine:1K:0.8
+//	square[:freq[:amp]]
+//	noise[:amp]
+//	file:path		Raw bytes, repeated at the end of the file
+//
+// Channel 2 uses --source2 (default: --source shifted by 90 degrees,
+// or the next byte of the file).
+// With --channels=2 (16 bit bus) each strobe gives two bytes, PB first.
+// The stream lasts --seconds (default 1, 0: endless) or --bytes.
+// --fast writes as fast as the consumer reads instead of in real time.
+// Output goes to stdout, --output (file or FIFO) or the first client
+// connecting to the Unix socket --socket. A summary goes to stderr.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <map>
+#include "gpif.h"
+#include "gpif_sim.h"
+#include "gpif_table.h"
+
+
+static const size_t packet_size = 512;
+static const size_t burst = 64;		// Packets per write at most
+
+static double ifclk = 0;		// Hz, 0: unknown
+static unsigned inputs = 0xFF;		// RDY / flag terms
+
+//////////////////////////////////////////////////////////////////////
+// DATA strobe schedule: the cycles of the strobes before the steady
+// state loop, then start + k * period + offsets[]
+//////////////////////////////////////////////////////////////////////
+
+struct s_schedule {
+	std::vector<uint64_t>	lead;
+	uint64_t		start;
+	uint64_t		period;
+	std::vector<uint64_t>	offsets;
+};
+
+// The firmware retriggers at once when the waveform goes idle
+static bool
+schedule(const s_state states[8],s_schedule& sched) {
+	std::map<uint32_t,uint64_t> seen;	// Machine state -> cycle
+	std::vector<uint64_t> data;
+	s_machine m;
+
+	machine_reset(m,states);
+	for ( uint64_t cycle=0; cycle < 0x100000; ++cycle ) {
+		const uint32_t key = m.state | m.remain << 3 | uint32_t(m.fresh) << 12;
+		auto it = seen.find(key);
+
+		if ( it != seen.end() ) {
+			sched.start = it->second;
+			sched.period = cycle - it->second;
+			for ( auto c : data ) {
+				if ( c < sched.start )
+					sched.lead.push_back(c);
+				else	sched.offsets.push_back(c - sched.start);
+			}
+			return !sched.offsets.empty();
+		}
+		seen[key] = cycle;
+
+		u_opcode actions;
+
+		actions.byte = machine_actions(m,states);
+		if ( actions.bits().data )
+			data.push_back(cycle);
+		machine_step(m,states,inputs);
+		if ( m.state >= 7 )
+			machine_reset(m,states);
+	}
+	return false;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Signal sources, sampled at a cycle
+//////////////////////////////////////////////////////////////////////
+
+enum class Wave {
+	Sine,
+	Square,
+	Noise,
+	File,
+};
+
+struct s_source {
+	Wave			wave = Wave::Sine;
+	double			freq = 1000;
+	double			amp = 0.8;
+	uint32_t		phase0 = 0;	// 2^32 == 360 degrees
+	uint64_t		step = 0;	// Phase per cycle, 32.32 fixed point
+	uint32_t		seed = 2463534242u;
+	std::vector<uint8_t>	bytes;		// Wave::File
+	size_t			pos = 0;
+};
+
+static uint8_t sine_lut[4096];
+
+static double
+number(const std::string& text) {
+	char *ep;
+	double v = strtod(text.c_str(),&ep);
+
+	if ( *ep == 'K' || *ep == 'k' )
+		v *= 1e3;
+	else if ( *ep == 'M' )
+		v *= 1e6;
+	return v;
+}
+
+static bool
+parse_source(const std::string& spec,s_source& src,std::string& error) {
+	std::vector<std::string> fields;
+	std::stringstream ss(spec);
+	std::string field;
+
+	while ( std::getline(ss,field,':') )
+		fields.push_back(field);
+	if ( fields.empty() ) {
+		error = "empty source";
+		return false;
+	}
+	if ( fields[0] == "file" ) {
+		std::ifstream is(spec.substr(5),std::ios::binary);
+
+		if ( fields.size() < 2 || !is ) {
+			error = std::string(strerror(errno)) + ": opening " + spec.substr(5);
+			return false;
+		}
+		src.wave = Wave::File;
+		src.bytes.assign(std::istreambuf_iterator<char>(is),std::istreambuf_iterator<char>());
+		if ( src.bytes.empty() ) {
+			error = spec.substr(5) + " is empty";
+			return false;
+		}
+		return true;
+	}
+	if ( fields[0] == "sine" || fields[0] == "square" ) {
+		src.wave = fields[0] == "sine" ? Wave::Sine : Wave::Square;
+		if ( fields.size() > 1 )
+			src.freq = number(fields[1]);
+		if ( fields.size() > 2 )
+			src.amp = number(fields[2]);
+		if ( fields.size() > 3 || src.freq <= 0 ) {
+			error = "invalid source '" + spec + "'";
+			return false;
+		}
+	} else if ( fields[0] == "noise" ) {
+		src.wave = Wave::Noise;
+		if ( fields.size() > 1 )
+			src.amp = number(fields[1]);
+		if ( fields.size() > 2 ) {
+			error = "invalid source '" + spec + "'";
+			return false;
+		}
+	} else	{
+		error = "unknown source '" + spec + "'";
+		return false;
+	}
+	if ( src.amp < 0 || src.amp > 1 ) {
+		error = "amplitude of '" + spec + "' must be 0..1";
+		return false;
+	}
+	return true;
+}
+
+static inline uint8_t
+scale(const s_source& src,int v) {		// v: -127..127
+	return uint8_t(128 + int(v * src.amp));
+}
+
+static inline uint8_t
+sample(s_source& src,uint64_t cycle) {
+	const uint32_t phase = uint32_t((cycle * src.step) >> 32) + src.phase0;
+
+	switch ( src.wave ) {
+	case Wave::Sine:
+		return scale(src,int(sine_lut[phase >> 20]) - 128);
+	case Wave::Square:
+		return scale(src,phase & 0x80000000u ? -127 : 127);
+	case Wave::Noise:
+		src.seed ^= src.seed << 13;	// xorshift32
+		src.seed ^= src.seed >> 17;
+		src.seed ^= src.seed << 5;
+		return scale(src,int(src.seed % 255) - 127);
+	case Wave::File:
+	default:
+		{
+			uint8_t b = src.bytes[src.pos];
+			if ( ++src.pos >= src.bytes.size() )
+				src.pos = 0;
+			return b;
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+// Output
+//////////////////////////////////////////////////////////////////////
+
+static bool
+write_full(int fd,const uint8_t *buf,size_t length) {
+	while ( length > 0 ) {
+		ssize_t n = write(fd,buf,length);
+
+		if ( n < 0 && errno == EINTR )
+			continue;
+		if ( n <= 0 )
+			return false;
+		buf += n;
+		length -= n;
+	}
+	return true;
+}
+
+static int
+open_socket(const char *path) {
+	struct sockaddr_un addr;
+	int sock = socket(AF_UNIX,SOCK_STREAM,0), conn;
+
+	if ( sock < 0 || strlen(path) >= sizeof addr.sun_path )
+		return -1;
+	memset(&addr,0,sizeof addr);
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path,path);
+	unlink(path);
+	if ( bind(sock,(struct sockaddr *)&addr,sizeof addr) < 0 || listen(sock,1) < 0 )
+		return -1;
+	std::cerr << "; waiting for a client on " << path << '\n';
+	conn = accept(sock,nullptr,nullptr);
+	close(sock);
+	unlink(path);
+	return conn;
+}
+
+static uint64_t
+now_ns() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return uint64_t(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+static void
+sleep_until(uint64_t ns) {
+	struct timespec ts;
+
+	ts.tv_sec = ns / 1000000000ull;
+	ts.tv_nsec = ns % 1000000000ull;
+	while ( clock_nanosleep(CLOCK_MONOTONIC,TIMER_ABSTIME,&ts,nullptr) == EINTR )
+		;
+}
+
+int
+main(int argc,char **argv) {
+	std::string spec, error, source = "sine", source2;
+	const char *output = nullptr, *socket_path = nullptr;
+	unsigned channels = 2;
+	double seconds = 1;
+	uint64_t max_bytes = 0;
+	bool fast = false;
+	s_wavetable table;
+	s_state states[8];
+	s_schedule sched;
+	s_source src[2];
+
+	for ( int ax=1; ax < argc; ++ax ) {
+		if ( !strncmp(argv[ax],"--ifclk=",8) )
+			ifclk = strtod(argv[ax]+8,nullptr);
+		else if ( !strncmp(argv[ax],"--inputs=",9) )
+			inputs = strtoul(argv[ax]+9,nullptr,0) & 0xFF;
+		else if ( !strcmp(argv[ax],"--channels=1") || !strcmp(argv[ax],"--channels=2") )
+			channels = argv[ax][11] - '0';
+		else if ( !strncmp(argv[ax],"--source=",9) )
+			source = argv[ax] + 9;
+		else if ( !strncmp(argv[ax],"--source2=",10) )
+			source2 = argv[ax] + 10;
+		else if ( !strncmp(argv[ax],"--seconds=",10) )
+			seconds = strtod(argv[ax]+10,nullptr);
+		else if ( !strncmp(argv[ax],"--bytes=",8) )
+			max_bytes = strtoull(argv[ax]+8,nullptr,0);
+		else if ( !strcmp(argv[ax],"--fast") )
+			fast = true;
+		else if ( !strncmp(argv[ax],"--output=",9) )
+			output = argv[ax] + 9;
+		else if ( !strncmp(argv[ax],"--socket=",9) )
+			socket_path = argv[ax] + 9;
+		else if ( argv[ax][0] != '-' && spec.empty() )
+			spec = argv[ax];
+		else	{
+			spec.clear();
+			break;
+		}
+	}
+	if ( spec.empty() || (output && socket_path) ) {
+		std::cerr << "Usage: " << argv[0] << " [--ifclk=hz] [--inputs=n] [--channels=1|2] [--source=spec] [--source2=spec]\n"
+			<< "       [--seconds=s|--bytes=n] [--fast] [--output=path|--socket=path] file.inc[:name]\n"
+			<< "spec:  sine[:freq[:amp]] square[:freq[:amp]] noise[:amp] file:path\n";
+		exit(2);
+	}
+	if ( !select_table(spec,table,error) ) {
+		std::cerr << "*** ERROR: " << error << '\n';
+		exit(1);
+	}
+	table_states(table,states);
+	if ( ifclk <= 0 && table.ifconfig >= 0 && (table.ifconfig & 0x80) )
+		ifclk = table.ifconfig & 0x40 ? 48e6 : 30e6;
+	if ( ifclk <= 0 ) {
+		std::cerr << "*** ERROR: IFCLK unknown, use --ifclk=hz\n";
+		exit(1);
+	}
+	if ( !schedule(states,sched) ) {
+		std::cerr << "*** ERROR: waveform " << table.name << " gives no DATA strobes in steady state (inputs 0x"
+			<< std::hex << inputs << std::dec << ")\n";
+		exit(1);
+	}
+
+	if ( !parse_source(source,src[0],error)
+	  || !parse_source(source2.empty() ? source : source2,src[1],error) ) {
+		std::cerr << "*** ERROR: " << error << '\n';
+		exit(2);
+	}
+	if ( source2.empty() )
+		src[1].phase0 = 0x40000000u;		// 90 degrees
+
+	// A file without --source2 holds the interleaved stream
+	s_source *chan[2] = { &src[0], src[0].wave == Wave::File && source2.empty() ? &src[0] : &src[1] };
+
+	for ( auto& s : src ) {
+		if ( s.wave != Wave::File && s.freq >= ifclk / 2 ) {
+			std::cerr << "*** ERROR: source frequency " << s.freq << " Hz not below IFCLK / 2\n";
+			exit(2);
+		}
+		s.step = uint64_t(s.freq / ifclk * 4294967296.0 * 4294967296.0 + 0.5);
+	}
+	for ( unsigned ux=0; ux<4096; ++ux )
+		sine_lut[ux] = uint8_t(128 + lround(127 * sin(ux * 2 * M_PI / 4096)));
+
+	int fd = 1;
+
+	signal(SIGPIPE,SIG_IGN);
+	if ( output ) {
+		fd = open(output,O_WRONLY|O_CREAT|O_TRUNC,0644);
+		if ( fd < 0 ) {
+			std::cerr << "*** ERROR: " << strerror(errno) << ": opening " << output << '\n';
+			exit(1);
+		}
+	} else if ( socket_path ) {
+		fd = open_socket(socket_path);
+		if ( fd < 0 ) {
+			std::cerr << "*** ERROR: " << strerror(errno) << ": socket " << socket_path << '\n';
+			exit(1);
+		}
+	}
+
+	const uint64_t end_cycle = seconds > 0 ? uint64_t(seconds * ifclk) : ~0ull;
+	const uint64_t t0 = now_ns();
+	std::vector<uint8_t> out(packet_size * burst);	// Packets due, not written yet
+	size_t fill = 0;
+	uint64_t bytes = 0, packets = 0, late_ns = 0, cycle = 0;
+	size_t lx = 0, ox = 0;
+	uint64_t base = sched.start;
+	bool ok = true;
+
+	for (;;) {
+		if ( lx < sched.lead.size() )
+			cycle = sched.lead[lx++];
+		else	{
+			cycle = base + sched.offsets[ox];
+			if ( ++ox >= sched.offsets.size() ) {
+				ox = 0;
+				base += sched.period;
+			}
+		}
+		if ( cycle >= end_cycle || (max_bytes && bytes >= max_bytes) )
+			break;
+
+		for ( unsigned cx=0; cx<channels; ++cx )
+			out[fill++] = sample(*chan[cx],cycle);
+		bytes += channels;
+		if ( fill % packet_size )
+			continue;
+
+		// Packet complete: write it when due, packets of a consumer
+		// running behind go out in bursts
+		bool flush = fill + packet_size > out.size();
+
+		++packets;
+		if ( !fast ) {
+			const uint64_t due = t0 + uint64_t((cycle + 1) * 1e9 / ifclk);
+			const uint64_t now = now_ns();
+
+			if ( now < due ) {
+				sleep_until(due);
+				flush = true;
+			} else if ( now - due > late_ns )
+				late_ns = now - due;
+		}
+		if ( flush ) {
+			if ( !(ok = write_full(fd,out.data(),fill)) )
+				break;
+			fill = 0;
+		}
+	}
+	if ( ok && fill ) {
+		if ( fill % packet_size )
+			++packets;			// Short packet
+		ok = write_full(fd,out.data(),fill);
+	}
+
+	const double elapsed = (now_ns() - t0) / 1e9;
+	const double period_s = sched.period / ifclk;
+
+	std::cerr << "; Waveform " << table.name << " (" << table.file << "), IFCLK " << ifclk / 1e6 << " MHz, "
+		<< std::fixed << std::setprecision(3)
+		<< sched.offsets.size() / period_s / 1e6 << " MS/s, "
+		<< channels << (channels == 1 ? " channel\n" : " channels\n")
+		<< "; " << bytes << " bytes in " << packets << " packets, " << elapsed << " s, "
+		<< bytes / elapsed / 1e6 << " MB/s";
+	if ( !fast )
+		std::cerr << ", max " << late_ns / 1e3 << " us behind";
+	std::cerr << '\n';
+	if ( !ok ) {
+		std::cerr << "*** ERROR: " << strerror(errno) << ": writing the stream\n";
+		return 1;
+	}
+	return 0;
+}
+
+// End gpif_stream.cpp
@@ -0,0 +1,181 @@
+//////////////////////////////////////////////////////////////////////
+// gpif_table.h -- Read compiled wave tables, shared by the tools
+///////////////////////////////////////////////////////////////////////
+//
+// Understands the output of gpif_compiler (waveform_n[ 32 ] arrays
+// and their ifconfig_n) and Cypress GPIF Designer gpif.c files
+// (WaveData[128], four slots named 0..3). A table is selected by
+// path[:name], without name the first one is used, "-" is stdin.
+// Needs gpif.h and gpif_sim.h.
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct s_wavetable {
+	std::string		file;
+	std::string		name;		// Waveform number or WaveData slot
+	int			ifconfig;	// -1: unknown
+	uint8_t			bytes[32];	// C array order: length/branch,
+						// opcode, output, logfunc
+};
+
+// States 0..6 and the idle state 7 of a table
+inline void
+table_states(const s_wavetable& table,s_state states[8]) {
+	for ( unsigned ux=0; ux<8; ++ux ) {
+		states[ux].branch.byte = table.bytes[ux];
+		states[ux].opcode.byte = table.bytes[ux+8];
+		states[ux].output.byte = table.bytes[ux+16];
+		states[ux].logfunc.byte = table.bytes[ux+24];
+	}
+	states[7].branch.byte = states[7].opcode.byte = 0;
+	states[7].output.byte = states[7].logfunc.byte = 0;
+}
+
+inline void
+tokenize(const std::string& text,std::vector<std::string>& tokens) {
+	size_t px = 0;
+
+	while ( px < text.size() ) {
+		char c = text[px];
+
+		if ( c == '/' && px + 1 < text.size() && text[px+1] == '/' ) {
+			px = text.find('\n',px);
+			if ( px == std::string::npos )
+				break;
+		} else if ( c == '/' && px + 1 < text.size() && text[px+1] == '*' ) {
+			px = text.find("*/",px+2);
+			if ( px == std::string::npos )
+				break;
+			px += 2;
+		} else if ( isalnum((unsigned char)c) || c == '_' ) {
+			size_t start = px;
+
+			while ( px < text.size() && (isalnum((unsigned char)text[px]) || text[px] == '_') )
+				++px;
+			tokens.push_back(text.substr(start,px-start));
+		} else	{
+			if ( !isspace((unsigned char)c) )
+				tokens.push_back(std::string(1,c));
+			++px;
+		}
+	}
+}
+
+inline bool
+read_tables(std::istream& is,const std::string& file,std::vector<s_wavetable>& tables,std::string& error) {
+	std::stringstream ss;
+	std::vector<std::string> tokens;
+	std::vector<std::pair<std::string,int>> ifconfigs;
+	const size_t first = tables.size();
+
+	ss << is.rdbuf();
+	tokenize(ss.str(),tokens);
+
+	for ( size_t tx=0; tx<tokens.size(); ++tx ) {
+		const std::string& token = tokens[tx];
+		const bool wavedata = token == "WaveData";
+
+		if ( !token.compare(0,9,"ifconfig_") && token.size() > 9 ) {
+			for ( size_t vx=tx+1; vx<tokens.size() && tokens[vx] != ";"; ++vx ) {
+				if ( isdigit((unsigned char)tokens[vx][0]) ) {
+					ifconfigs.push_back({ token.substr(9), int(strtoul(tokens[vx].c_str(),nullptr,0)) });
+					break;
+				}
+				if ( tokens[vx] != "=" )
+					break;
+			}
+			continue;
+		}
+		if ( !wavedata && (token.compare(0,9,"waveform_") || token.size() <= 9) )
+			continue;
+
+		std::vector<uint8_t> raw;
+		size_t vx = tx + 1;
+
+		while ( vx < tokens.size() && tokens[vx] != "{" && tokens[vx] != ";"
+		  && tokens[vx] != "," && tokens[vx] != "}" )
+			++vx;
+		if ( vx >= tokens.size() || tokens[vx] != "{" )
+			continue;			// Declaration or use only
+		for ( ++vx; vx < tokens.size() && tokens[vx] != "}"; ++vx ) {
+			if ( tokens[vx] == "," )
+				continue;
+			char *ep;
+			unsigned long u = strtoul(tokens[vx].c_str(),&ep,0);
+			if ( *ep || u > 0xFF ) {
+				error = file + ": invalid data '" + tokens[vx] + "' in " + token;
+				return false;
+			}
+			raw.push_back(uint8_t(u));
+		}
+		if ( raw.empty() || raw.size() % 32 || (!wavedata && raw.size() != 32) ) {
+			std::stringstream es;
+			es << file << ": " << token << " has " << raw.size() << " bytes";
+			error = es.str();
+			return false;
+		}
+		for ( size_t ox=0; ox<raw.size(); ox += 32 ) {
+			s_wavetable table;
+
+			table.file = file;
+			table.name = wavedata ? std::to_string(ox / 32) : token.substr(9);
+			table.ifconfig = -1;
+			std::copy(raw.begin()+ox,raw.begin()+ox+32,table.bytes);
+			tables.push_back(table);
+		}
+		tx = vx;
+	}
+
+	for ( size_t ux=first; ux<tables.size(); ++ux )
+		for ( auto& pair : ifconfigs )
+			if ( pair.first == tables[ux].name )
+				tables[ux].ifconfig = pair.second;
+
+	if ( tables.size() == first ) {
+		error = file + ": no wave table found";
+		return false;
+	}
+	return true;
+}
+
+inline bool
+read_tables(const std::string& path,std::vector<s_wavetable>& tables,std::string& error) {
+	if ( path == "-" )
+		return read_tables(std::cin,"<stdin>",tables,error);
+
+	std::ifstream is(path);
+
+	if ( !is ) {
+		error = std::string(strerror(errno)) + ": opening " + path;
+		return false;
+	}
+	return read_tables(is,path,tables,error);
+}
+
+// path[:name]
+inline bool
+select_table(const std::string& spec,s_wavetable& table,std::string& error) {
+	std::vector<s_wavetable> tables;
+	std::string path = spec, name;
+	size_t colon = spec.rfind(':');
+
+	if ( colon != std::string::npos ) {
+		path = spec.substr(0,colon);
+		name = spec.substr(colon+1);
+	}
+	if ( !read_tables(path,tables,error) )
+		return false;
+	for ( auto& t : tables ) {
+		if ( name.empty() || t.name == name ) {
+			table = t;
+			return true;
+		}
+	}
+	error = path + ": no wave table " + name;
+	return false;
+}
+
+// End gpif_table.h
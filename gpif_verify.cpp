@@ -0,0 +1,642 @@
+//////////////////////////////////////////////////////////////////////
+// gpif_verify.cpp -- Check of the gpif.h field codec and the tools
+///////////////////////////////////////////////////////////////////////
+//
+// Enumerates all 2^32 state words (length/branch, opcode, logfunc and
+// output byte of one state) on all cores and checks for each that
+//
+//	- decoding every field through the const views agrees with the
+//	  EZ-USB TRM register layout, written out with explicit masks below
+//	- encoding the decoded fields field by field from 0, as the
+//	  compiler does, gives the word back
+//	- assigning a field leaves the other fields of its byte alone,
+//	  and assigning one field from another copies the value
+//
+//    $ ./gpif_verify [--threads=n] [--bits=n] [--tools=n]
+//
+// --bits=n checks a sample of 2^n words spread over the whole range,
+// for a quick run (make test uses 2^24).
+//
+// --tools=n then checks that the tools agree: n random 7 state tables
+// (TRICTL 0 and 1, all opcode flags, terms, functions and targets) are
+// written as source, compiled by gpif_compiler, decompiled from a
+// gpif.c by gpif_decompiler and shown by gpif_show. The fields of the
+// compiled bytes, of the bytes and mnemonics the decompiler lists and
+// of the rows gpif_show draws must all be those of the random table.
+// The tools are run from the directory of gpif_verify.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <sstream>
+#include <string>
+#include "gpif.h"
+
+
+// The TRM layout of the wave table bytes
+struct s_reference {
+	unsigned	dp, data, next, incad, gint, sgl;
+	unsigned	terma, termb, lfunc;
+	unsigned	branchon0, branchon1, reexecute;
+	unsigned	ctl[6], oe[4];
+};
+
+static s_reference
+reference(uint32_t word) {
+	const uint8_t branch = word, opcode = word >> 8, logfunc = word >> 16, output = word >> 24;
+	s_reference r;
+
+	r.dp = opcode & 0x01;
+	r.data = (opcode & 0x02) >> 1;
+	r.next = (opcode & 0x04) >> 2;
+	r.incad = (opcode & 0x08) >> 3;
+	r.gint = (opcode & 0x10) >> 4;
+	r.sgl = (opcode & 0x20) >> 5;
+	r.termb = logfunc & 0x07;
+	r.terma = (logfunc & 0x38) >> 3;
+	r.lfunc = (logfunc & 0xC0) >> 6;
+	r.branchon0 = branch & 0x07;
+	r.branchon1 = (branch & 0x38) >> 3;
+	r.reexecute = (branch & 0x80) >> 7;
+	for ( unsigned ux=0; ux<6; ++ux )
+		r.ctl[ux] = (output >> ux) & 1;
+	for ( unsigned ux=0; ux<4; ++ux )
+		r.oe[ux] = (output >> (ux + 4)) & 1;
+	return r;
+}
+
+// Returns 0 or a description of the first check failing for word
+static const char *
+check(uint32_t word) {
+	const u_branch branch = { uint8_t(word) };
+	const u_opcode opcode = { uint8_t(word >> 8) };
+	const u_logfunc logfunc = { uint8_t(word >> 16) };
+	const u_output output = { uint8_t(word >> 24) };
+	const s_reference r = reference(word);
+
+	// Decode through the read-only views
+	if ( opcode.bits().dp != r.dp || opcode.bits().data != r.data || opcode.bits().next != r.next
+	  || opcode.bits().incad != r.incad || opcode.bits().gint != r.gint || opcode.bits().sgl != r.sgl )
+		return "opcode decode";
+	if ( logfunc.bits().terma != r.terma || logfunc.bits().termb != r.termb || logfunc.bits().lfunc != r.lfunc )
+		return "logfunc decode";
+	if ( branch.bits().branchon0 != r.branchon0 || branch.bits().branchon1 != r.branchon1
+	  || branch.bits().reexecute != r.reexecute )
+		return "branch decode";
+	if ( output.bits0().ctl0 != r.ctl[0] || output.bits0().ctl1 != r.ctl[1] || output.bits0().ctl2 != r.ctl[2]
+	  || output.bits0().ctl3 != r.ctl[3] || output.bits0().ctl4 != r.ctl[4] || output.bits0().ctl5 != r.ctl[5]
+	  || output.bits1().ctl0 != r.ctl[0] || output.bits1().ctl3 != r.ctl[3]
+	  || output.bits1().oes0 != r.oe[0] || output.bits1().oes1 != r.oe[1]
+	  || output.bits1().oes2 != r.oe[2] || output.bits1().oes3 != r.oe[3] )
+		return "output decode";
+
+	// Encode field by field through the writable views
+	u_branch b2;
+	u_opcode o2;
+	u_logfunc l2;
+	u_output x2, y2;
+
+	b2.byte = o2.byte = l2.byte = x2.byte = y2.byte = 0;
+	o2.bits().dp = r.dp;
+	o2.bits().sgl = r.sgl;
+	o2.bits().incad = r.incad;
+	o2.bits().gint = r.gint;
+	o2.bits().next = r.next;
+	o2.bits().data = r.data;
+	o2.bits().reserved = opcode.bits().reserved;
+	l2.bits().terma = r.terma;
+	l2.bits().termb = r.termb;
+	l2.bits().lfunc = r.lfunc;
+	b2.bits().branchon0 = r.branchon0;
+	b2.bits().branchon1 = r.branchon1;
+	b2.bits().reserved = branch.bits().reserved;
+	b2.bits().reexecute = r.reexecute;
+	x2.bits1().ctl0 = r.ctl[0];
+	x2.bits1().ctl1 = r.ctl[1];
+	x2.bits1().ctl2 = r.ctl[2];
+	x2.bits1().ctl3 = r.ctl[3];
+	x2.bits1().oes0 = r.oe[0];
+	x2.bits1().oes1 = r.oe[1];
+	x2.bits1().oes2 = r.oe[2];
+	x2.bits1().oes3 = r.oe[3];
+	y2.bits0().ctl0 = r.ctl[0];
+	y2.bits0().ctl1 = r.ctl[1];
+	y2.bits0().ctl2 = r.ctl[2];
+	y2.bits0().ctl3 = r.ctl[3];
+	y2.bits0().ctl4 = r.ctl[4];
+	y2.bits0().ctl5 = r.ctl[5];
+	y2.bits0().reserved = output.bits0().reserved;
+	if ( o2.byte != opcode.byte || l2.byte != logfunc.byte || b2.byte != branch.byte
+	  || x2.byte != output.byte || y2.byte != output.byte )
+		return "encode";
+
+	// Assigning a field keeps the others
+	b2.bits().branchon1 = ~r.branchon1;
+	if ( b2.bits().branchon0 != r.branchon0 || b2.bits().reexecute != r.reexecute
+	  || b2.bits().branchon1 != (~r.branchon1 & 7) )
+		return "branch field isolation";
+	l2.bits().terma = ~r.terma;
+	if ( l2.bits().termb != r.termb || l2.bits().lfunc != r.lfunc )
+		return "logfunc field isolation";
+	o2.bits().data = !r.data;
+	if ( o2.byte != (opcode.byte ^ 0x02) )
+		return "opcode field isolation";
+
+	// Field to field assignment copies the value, not the view
+	y2.byte = 0;
+	y2.bits0().ctl5 = output.bits1().oes1;
+	y2.bits0().ctl0 = x2.bits1().ctl0;
+	if ( y2.byte != (r.oe[1] << 5 | r.ctl[0]) || x2.byte != output.byte )
+		return "field copy";
+	return nullptr;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Agreement of the tools: random tables are written as source,
+// compiled by gpif_compiler, decompiled by gpif_decompiler and shown
+// by gpif_show, and every field each of them gives back is compared
+// with the one the table was made of.
+//////////////////////////////////////////////////////////////////////
+
+// One state of a random table
+struct s_model {
+	unsigned	dp, data, next, incad, gint, sgl, reexecute;
+	unsigned	count;			// NDP: 1..256
+	unsigned	terma, termb, lfunc;	// DP
+	unsigned	branchon1, branchon0;	// DP
+	unsigned	output;			// Output byte
+};
+
+static const char *term_names[8] = { "RDY0", "RDY1", "RDY2", "RDY3", "RDY4", "RDY5", "EF", "INTRDY" };
+static const char *func_names[4] = { "AND", "OR", "XOR", "/AND" };
+
+// Random program, state 0 of a TRICTL=1 program drives OE3 so the
+// decompiler, which guesses TRICTL from OE3/OE2, sees it at once
+static void
+random_program(std::mt19937& rng,unsigned trictl,s_model states[7]) {
+	for ( unsigned sx=0; sx<7; ++sx ) {
+		s_model& m = states[sx];
+
+		m = s_model();
+		m.dp = rng() & 1;
+		m.data = rng() & 1;
+		m.next = rng() & 1;
+		m.incad = rng() & 1;
+		m.gint = rng() & 1;
+		m.sgl = rng() & 1;
+		m.output = rng() & (trictl ? 0xFF : 0x3F);
+		if ( m.dp ) {
+			m.reexecute = rng() & 1;
+			m.terma = rng() % 8;
+			m.termb = rng() % 8;
+			m.lfunc = rng() % 4;
+			m.branchon1 = rng() % 8;
+			m.branchon0 = rng() % 8;
+		} else	m.count = 1 + rng() % 256;
+	}
+	if ( trictl )
+		states[0].output |= 0x80;
+}
+
+static std::string
+source(unsigned trictl,const s_model states[7]) {
+	std::stringstream ss;
+
+	ss << "\t.TRICTL\t\t" << trictl << "\n\t.GPIFREADYCFG7\t1\n\t.EPXGPIFFLGSEL\tEF\n\t.WAVEFORM\t1\n";
+	for ( unsigned sx=0; sx<7; ++sx ) {
+		const s_model& m = states[sx];
+		std::string opc = m.dp ? "J" : "";
+
+		if ( m.sgl ) opc += 'S';
+		if ( m.incad ) opc += '+';
+		if ( m.gint ) opc += 'G';
+		if ( m.next ) opc += 'N';
+		if ( m.data ) opc += 'D';
+		if ( m.dp && m.reexecute ) opc += '*';
+		if ( opc.empty() ) opc = "Z";
+		ss << '\t' << opc << '\t';
+		if ( m.dp )
+			ss << term_names[m.terma] << ' ' << func_names[m.lfunc] << ' ' << term_names[m.termb];
+		else	ss << m.count;
+		for ( unsigned bx=0; bx<8; ++bx )
+			if ( m.output >> bx & 1 )
+				ss << ' ' << (trictl && bx >= 4 ? "OE" : "CTL") << (trictl && bx >= 4 ? bx - 4 : bx);
+		if ( m.dp )
+			ss << " $" << m.branchon1 << " $" << m.branchon0;
+		ss << '\n';
+	}
+	return ss.str();
+}
+
+// The fields of state sx of a table in C array order, by the TRM masks
+static s_model
+model_of(const uint8_t bytes[32],unsigned sx) {
+	const uint8_t branch = bytes[sx], opcode = bytes[sx+8], output = bytes[sx+16], logfunc = bytes[sx+24];
+	const s_reference r = reference(branch | opcode << 8 | logfunc << 16 | uint32_t(output) << 24);
+	s_model m = s_model();
+
+	m.dp = r.dp;
+	m.data = r.data;
+	m.next = r.next;
+	m.incad = r.incad;
+	m.gint = r.gint;
+	m.sgl = r.sgl;
+	m.output = output;
+	if ( m.dp ) {
+		m.reexecute = r.reexecute;
+		m.terma = r.terma;
+		m.termb = r.termb;
+		m.lfunc = r.lfunc;
+		m.branchon1 = r.branchon1;
+		m.branchon0 = r.branchon0;
+	} else	m.count = branch ? branch : 256;
+	return m;
+}
+
+// Name of the first field differing, nullptr if none. Bits of the
+// output byte not in output_mask are not compared.
+static const char *
+compare(const s_model& want,const s_model& got,unsigned output_mask = 0xFF) {
+	if ( want.dp != got.dp ) return "dp";
+	if ( want.data != got.data ) return "data";
+	if ( want.next != got.next ) return "next";
+	if ( want.incad != got.incad ) return "incad";
+	if ( want.gint != got.gint ) return "gint";
+	if ( want.sgl != got.sgl ) return "sgl";
+	if ( ((want.output ^ got.output) & output_mask) ) return "output";
+	if ( !want.dp )
+		return want.count != got.count ? "count" : nullptr;
+	if ( want.reexecute != got.reexecute ) return "reexecute";
+	if ( want.terma != got.terma ) return "terma";
+	if ( want.termb != got.termb ) return "termb";
+	if ( want.lfunc != got.lfunc ) return "lfunc";
+	if ( want.branchon1 != got.branchon1 ) return "branchon1";
+	if ( want.branchon0 != got.branchon0 ) return "branchon0";
+	return nullptr;
+}
+
+static std::string
+run(const std::string& command) {
+	std::string text;
+	char buf[4096];
+	FILE *pipe = popen(command.c_str(),"r");
+	size_t n;
+
+	if ( !pipe )
+		return text;
+	while ( (n = fread(buf,1,sizeof buf,pipe)) > 0 )
+		text.append(buf,n);
+	pclose(pipe);
+	return text;
+}
+
+static bool
+write_file(const std::string& path,const std::string& text) {
+	FILE *f = fopen(path.c_str(),"w");
+
+	if ( !f )
+		return false;
+	fputs(text.c_str(),f);
+	return fclose(f) == 0;
+}
+
+// The 32 bytes of waveform_1[] in gpif_compiler output
+static bool
+compiled_table(const std::string& text,uint8_t bytes[32]) {
+	size_t px = text.find("waveform_1[ 32 ] = {");
+
+	if ( px == std::string::npos )
+		return false;
+	for ( unsigned bx=0; bx<32; ++bx ) {
+		px = text.find("0x",px);
+		if ( px == std::string::npos )
+			return false;
+		bytes[bx] = uint8_t(strtoul(text.c_str()+px,nullptr,16));
+		px += 2;
+	}
+	return true;
+}
+
+// The states gpif_decompiler lists: its hex bytes (branch, opcode,
+// logfunc, output) and its mnemonics, parsed back into fields
+static bool
+decompiled_states(const std::string& text,s_model bytes[7],s_model mnemonics[7]) {
+	std::istringstream is(text);
+	std::string line;
+	unsigned sx = 0;
+
+	while ( sx < 7 && std::getline(is,line) ) {
+		if ( line.size() < 10 || line[8] != '\t' || !isxdigit((unsigned char)line[0]) )
+			continue;
+
+		const uint32_t word = strtoul(line.substr(0,8).c_str(),nullptr,16);
+		uint8_t table[32] = { 0 };
+
+		table[sx] = word >> 24;
+		table[sx+8] = word >> 16;
+		table[sx+24] = word >> 8;
+		table[sx+16] = word;
+		bytes[sx] = model_of(table,sx);
+
+		std::istringstream fields(line.substr(9));
+		std::string opc, token;
+		std::vector<std::string> tokens;
+		s_model& m = mnemonics[sx];
+
+		fields >> opc;
+		while ( fields >> token )
+			tokens.push_back(token);
+		m = s_model();
+		for ( char c : opc ) {
+			switch ( c ) {
+			case 'J': m.dp = 1; break;
+			case 'S': m.sgl = 1; break;
+			case '+': m.incad = 1; break;
+			case 'G': m.gint = 1; break;
+			case 'N': m.next = 1; break;
+			case 'D': m.data = 1; break;
+			case '*': m.reexecute = 1; break;
+			}
+		}
+
+		auto term = [](const std::string& name) -> unsigned {
+			if ( name == "RDY5|TC" ) return 5;
+			if ( name == "PF|EF|FF" ) return 6;
+			if ( name == "INTRDY" ) return 7;
+			return name.compare(0,3,"RDY") ? 8 : strtoul(name.c_str()+3,nullptr,10);
+		};
+		unsigned tx = 0, targets = 0;
+
+		if ( m.dp ) {
+			if ( tokens.size() < 3 )
+				return false;
+			m.terma = term(tokens[0]);
+			m.termb = term(tokens[2]);
+			for ( unsigned fx=0; fx<4; ++fx )
+				if ( tokens[1] == func_names[fx] )
+					m.lfunc = fx;
+			tx = 3;
+		} else if ( !tokens.empty() )
+			m.count = strtoul(tokens[tx++].c_str(),nullptr,10);
+		for ( ; tx<tokens.size(); ++tx ) {
+			const std::string& t = tokens[tx];
+
+			if ( t[0] == '$' )
+				(targets++ ? m.branchon0 : m.branchon1) = strtoul(t.c_str()+1,nullptr,10);
+			else if ( !t.compare(0,3,"OES") )
+				m.output |= 1u << (4 + strtoul(t.c_str()+3,nullptr,10));
+			else if ( !t.compare(0,3,"CTL") )
+				m.output |= 1u << strtoul(t.c_str()+3,nullptr,10);
+		}
+		++sx;
+	}
+	return sx == 7;
+}
+
+// The states gpif_show draws: its rows after the dashes, each with a
+// label of fixed width and a column of 10 characters per state
+static bool
+shown_states(const std::string& text,s_model states[7]) {
+	static const unsigned label[16] = { 15, 15, 16, 15, 16, 16, 16, 16, 16, 16, 16, 16, 14, 14, 14, 14 };
+	std::istringstream is(text);
+	std::vector<std::string> rows;
+	std::string line;
+
+	while ( std::getline(is,line) && line.find("---------") == std::string::npos )
+		;
+	while ( rows.size() < 16 && std::getline(is,line) )
+		rows.push_back(line);
+	if ( rows.size() < 16 )
+		return false;
+
+	auto cell = [&](unsigned rx,unsigned sx) -> std::string {
+		const std::string& row = rows[rx];
+		const size_t px = label[rx] + 10 * sx;
+		std::string c = px < row.size() ? row.substr(px,10) : "";
+		size_t a = c.find_first_not_of(' '), b = c.find_last_not_of(' ');
+
+		return a == std::string::npos ? "" : c.substr(a,b-a+1);
+	};
+
+	for ( unsigned sx=0; sx<7; ++sx ) {
+		s_model& m = states[sx];
+		const std::string nextdata = cell(2,sx);
+
+		m = s_model();
+		m.incad = cell(0,sx) == "++";
+		m.data = cell(1,sx) == "DATA";
+		m.sgl = nextdata == "UDMACRC" || nextdata == "SGLDAT";
+		m.next = nextdata == "UDMACRC" || nextdata == "++";
+		m.gint = cell(3,sx) == "INT4";
+		m.dp = cell(5,sx) == "if";
+		if ( m.dp ) {
+			const std::string terms[2] = { cell(6,sx), cell(8,sx) };
+			unsigned values[2] = { 8, 8 };
+
+			for ( unsigned ax=0; ax<2; ++ax )
+				for ( unsigned tx=0; tx<8; ++tx )
+					if ( terms[ax] == (tx == 6 ? "FIFO" : term_names[tx]) )
+						values[ax] = tx;
+			m.terma = values[0];
+			m.termb = values[1];
+			for ( unsigned fx=0; fx<4; ++fx )
+				if ( cell(7,sx) == func_names[fx] )
+					m.lfunc = fx;
+			m.branchon1 = strtoul(cell(9,sx).c_str()+5,nullptr,10);
+			m.branchon0 = strtoul(cell(10,sx).c_str()+5,nullptr,10);
+			m.reexecute = cell(11,sx) == "ReExec";
+		} else	m.count = strtoul(cell(4,sx).c_str(),nullptr,10);
+		for ( unsigned cx=0; cx<4; ++cx ) {
+			const std::string level = cell(12 + cx,sx);
+
+			if ( !level.empty() )		// Driven: OE and level
+				m.output |= 1u << (4 + cx) | (level == "1" ? 1u << cx : 0);
+		}
+	}
+	return true;
+}
+
+// Checks n random tables, returns the number failing
+static unsigned
+check_tools(const std::string& bindir,unsigned n) {
+	char tmpl[] = "/tmp/gpif_verifyXXXXXX";
+	int fd = mkstemp(tmpl);
+	unsigned failures = 0;
+
+	if ( fd < 0 ) {
+		std::cerr << "*** ERROR: " << strerror(errno) << ": " << tmpl << '\n';
+		return n;
+	}
+	close(fd);
+
+	const std::string base = tmpl, wvf = base + ".wvf", inc = base + ".inc", gpif_c = base + ".c";
+
+	for ( unsigned px=0; px<n; ++px ) {
+		std::mt19937 rng(px);
+		const unsigned trictl = px & 1;
+		s_model want[7], got[7], mnemonics[7];
+		uint8_t bytes[32];
+		std::string tool;
+		const char *field = nullptr;
+		unsigned sx = 0;
+
+		random_program(rng,trictl,want);
+		write_file(wvf,source(trictl,want));
+
+		// gpif_compiler
+		const std::string compiled = run(bindir + "gpif_compiler < " + wvf + " 2>/dev/null");
+
+		tool = "gpif_compiler";
+		if ( !compiled_table(compiled,bytes) )
+			field = "no table";
+		for ( sx=0; !field && sx<7; ++sx )
+			if ( (field = compare(want[sx],model_of(bytes,sx))) )
+				break;
+
+		// gpif_decompiler, from a gpif.c of the compiled table
+		if ( !field ) {
+			std::stringstream ss;
+
+			ss << "const char xdata WaveData[128] =\n{\n";
+			for ( unsigned bx=0; bx<32; ++bx )
+				ss << "0x" << std::hex << std::uppercase << unsigned(bytes[bx]) << ',' << (bx % 8 == 7 ? "\n" : "");
+			ss << "};\n";
+			write_file(gpif_c,ss.str());
+			tool = "gpif_decompiler";
+			if ( !decompiled_states(run(bindir + "gpif_decompiler " + gpif_c + " 2>/dev/null"),got,mnemonics) )
+				field = "no listing";
+			for ( sx=0; !field && sx<7; ++sx ) {
+				if ( (field = compare(want[sx],got[sx])) )
+					break;
+				if ( (field = compare(want[sx],mnemonics[sx])) ) {
+					tool = "gpif_decompiler mnemonics";
+					break;
+				}
+			}
+		}
+
+		// gpif_show, from the compiler output
+		if ( !field ) {
+			write_file(inc,compiled);
+			tool = "gpif_show";
+			if ( !shown_states(run(bindir + "gpif_show " + inc + " 2>/dev/null"),got) )
+				field = "no table";
+			for ( sx=0; !field && sx<7; ++sx ) {
+				// Shown as TRICTL=1: OE0..3, the levels of driven CTL0..3 only
+				const unsigned mask = 0xF0 | want[sx].output >> 4;
+
+				if ( (field = compare(want[sx],got[sx],mask)) )
+					break;
+			}
+		}
+
+		if ( field ) {
+			if ( !failures )
+				std::cerr << "*** ERROR: table " << px << ", " << tool << ", state " << sx
+					<< ": " << field << "\n" << source(trictl,want);
+			++failures;
+		}
+	}
+	unlink(wvf.c_str());
+	unlink(inc.c_str());
+	unlink(gpif_c.c_str());
+	unlink(tmpl);
+	return failures;
+}
+
+int
+main(int argc,char **argv) {
+	unsigned threads = std::thread::hardware_concurrency(), bits = 32, tools = 0;
+
+	for ( int ax=1; ax < argc; ++ax ) {
+		if ( !strncmp(argv[ax],"--threads=",10) )
+			threads = strtoul(argv[ax]+10,nullptr,10);
+		else if ( !strncmp(argv[ax],"--bits=",7) )
+			bits = strtoul(argv[ax]+7,nullptr,10);
+		else if ( !strncmp(argv[ax],"--tools=",8) )
+			tools = strtoul(argv[ax]+8,nullptr,10);
+		else	{
+			std::cerr << "Usage: " << argv[0] << " [--threads=n] [--bits=n] [--tools=n]\n";
+			exit(2);
+		}
+	}
+	if ( threads < 1 )
+		threads = 1;
+	if ( bits < 8 || bits > 32 ) {
+		std::cerr << "*** ERROR: --bits=" << bits << " must be 8..32\n";
+		exit(2);
+	}
+
+	// Word i * odd constant: a bijection of the 2^32 words, the first
+	// 2^n spread over all of them
+	const uint64_t words = 1ull << bits, chunk = 1ull << 16;
+	std::atomic<uint64_t> next(0), failures(0);
+	std::atomic<uint64_t> first_bad(~0ull);
+	std::vector<std::thread> workers;
+	const auto t0 = std::chrono::steady_clock::now();
+
+	for ( unsigned tx=0; tx<threads; ++tx ) {
+		workers.emplace_back([&]() {
+			for (;;) {
+				const uint64_t from = next.fetch_add(chunk);
+
+				if ( from >= words )
+					break;
+				for ( uint64_t ix=from; ix < from + chunk && ix < words; ++ix ) {
+					const uint32_t word = uint32_t(ix) * 0x9E3779B1u;
+
+					if ( check(word) ) {
+						uint64_t bad = first_bad.load();
+
+						++failures;
+						while ( word < bad && !first_bad.compare_exchange_weak(bad,word) )
+							;
+					}
+				}
+			}
+		});
+	}
+	for ( auto& w : workers )
+		w.join();
+
+	const double ms = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+	std::cout << "; " << words << " state words, " << threads << " threads, "
+		<< std::fixed << std::setprecision(1) << ms << " ms\n";
+	if ( failures ) {
+		std::cerr << "*** ERROR: " << failures << " words fail, first 0x"
+			<< std::hex << std::setw(8) << std::setfill('0') << first_bad.load() << std::dec
+			<< " (" << check(uint32_t(first_bad.load())) << ")\n";
+		return 1;
+	}
+	std::cout << "; codec agrees with the TRM layout\n";
+
+	if ( tools ) {
+		// The tools next to this one, else from PATH
+		const std::string path = argv[0];
+		const size_t slash = path.rfind('/');
+		const std::string bindir = slash == std::string::npos ? "" : path.substr(0,slash+1);
+		const unsigned bad = check_tools(bindir,tools);
+
+		if ( bad ) {
+			std::cerr << "*** ERROR: " << bad << " of " << tools << " tables disagree\n";
+			return 1;
+		}
+		std::cout << "; " << tools << " random tables agree in gpif_compiler, gpif_decompiler and gpif_show\n";
+	}
+	return 0;
+}
+
+// End gpif_verify.cpp